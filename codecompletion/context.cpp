@@ -25,6 +25,7 @@
 
 #include "parser/golexer.h"
 #include "parser/goparser.h"
+#include "parser/tokenpositions.h"
 #include "expressionvisitor.h"
 #include "types/gostructuretype.h"
 #include "items/completionitem.h"
@@ -269,6 +270,7 @@ QStack< CodeCompletionContext::ExpressionStackEntry > CodeCompletionContext::exp
     QByteArray expr(expression.toUtf8());
     KDevPG::QByteArrayIterator iter(expr);
     Lexer lexer(iter);
+    TokenPositions positions(expr, &lexer);
     bool atEnd=false;
     ExpressionStackEntry entry;
     
@@ -279,7 +281,6 @@ QStack< CodeCompletionContext::ExpressionStackEntry > CodeCompletionContext::exp
     
     stack.push(entry);
     
-    qint64 line, lineEnd, column, columnEnd;
     while(!atEnd)
     {
 	KDevPG::Token token(lexer.read());
@@ -291,9 +292,7 @@ QStack< CodeCompletionContext::ExpressionStackEntry > CodeCompletionContext::exp
 	case Parser::Token_LBRACE:
 	case Parser::Token_LBRACKET:
 	case Parser::Token_LPAREN:
-	    qint64 sline, scolumn;
-	    lexer.locationTable()->positionAt(token.begin, &sline, &scolumn);
-            entry.startPosition = scolumn+1;
+            entry.startPosition = positions.end(lexer.index()-1).column;
             entry.operatorStart = entry.startPosition;
             entry.operatorEnd = entry.startPosition;
             entry.commas = 0;
@@ -312,10 +311,8 @@ QStack< CodeCompletionContext::ExpressionStackEntry > CodeCompletionContext::exp
 	    //two identifiers in a row is not possible? 
 	    if(lexer.size() > 0 && lexer.at(lexer.index()-2).kind == Parser::Token_IDENT)
 	    {
-		lexer.locationTable()->positionAt(lexer.at(lexer.index()-2).begin, &line, &column);
-		lexer.locationTable()->positionAt(lexer.at(lexer.index()-2).end+1, &lineEnd, &columnEnd);
-		stack.top().operatorStart = column;
-		stack.top().operatorEnd = columnEnd;
+		stack.top().operatorStart = positions.start(lexer.index()-2).column;
+		stack.top().operatorEnd = positions.end(lexer.index()-2).column;
 	    }
 	    break;
 	case Parser::Token_DOT:
@@ -327,10 +324,8 @@ QStack< CodeCompletionContext::ExpressionStackEntry > CodeCompletionContext::exp
             // so that "A = foo." can know that attributes of foo having the same
             // type as A should be highlighted.
 	    qCDebug(COMPLETION) << token.kind;
-	    lexer.locationTable()->positionAt(token.begin, &line, &column);
-	    lexer.locationTable()->positionAt(token.end+1, &lineEnd, &columnEnd);
-            stack.top().operatorStart = column;
-            stack.top().operatorEnd = columnEnd;
+            stack.top().operatorStart = positions.start(lexer.index()-1).column;
+            stack.top().operatorEnd = positions.end(lexer.index()-1).column;
 	    
 	}
     }
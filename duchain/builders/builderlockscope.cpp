@@ -0,0 +1,113 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "builderlockscope.h"
+
+#include <language/duchain/duchain.h>
+#include <language/duchain/duchainlock.h>
+
+#include <QElapsedTimer>
+
+#include <atomic>
+
+using namespace KDevelop;
+
+namespace go
+{
+
+namespace
+{
+
+std::atomic<quint64> acquisitions(0);
+std::atomic<quint64> contended(0);
+std::atomic<quint64> nested(0);
+std::atomic<qint64> waitedNanoseconds(0);
+
+thread_local BuilderLockScope::Statistics threadCounters = {0, 0, 0, 0};
+
+}
+
+BuilderLockScope::BuilderLockScope() : m_locked(false)
+{
+    DUChainLock* lock = DUChain::lock();
+    if(lock->currentThreadHasWriteLock())
+    {
+        ++nested;
+        ++threadCounters.nested;
+        return;
+    }
+    //read lock can't be upgraded, lockers inside will have to deal with it as before
+    if(lock->currentThreadHasReadLock())
+        return;
+    QElapsedTimer timer;
+    timer.start();
+    //short attempt first tells whether lock was held by other threads
+    if(!lock->lockForWrite(1))
+    {
+        ++contended;
+        ++threadCounters.contended;
+        lock->lockForWrite();
+    }
+    qint64 waited = timer.nsecsElapsed();
+    waitedNanoseconds += waited;
+    threadCounters.waitedNanoseconds += waited;
+    ++acquisitions;
+    ++threadCounters.acquisitions;
+    m_locked = true;
+}
+
+BuilderLockScope::~BuilderLockScope()
+{
+    if(m_locked)
+        DUChain::lock()->releaseWriteLock();
+}
+
+BuilderLockScope::Statistics BuilderLockScope::statistics()
+{
+    Statistics result;
+    result.acquisitions = acquisitions;
+    result.contended = contended;
+    result.nested = nested;
+    result.waitedNanoseconds = waitedNanoseconds;
+    return result;
+}
+
+BuilderLockScope::Statistics BuilderLockScope::threadStatistics()
+{
+    return threadCounters;
+}
+
+BuilderLockScope::Statistics BuilderLockScope::Statistics::since(const Statistics& start) const
+{
+    Statistics result;
+    result.acquisitions = acquisitions - start.acquisitions;
+    result.contended = contended - start.contended;
+    result.nested = nested - start.nested;
+    result.waitedNanoseconds = waitedNanoseconds - start.waitedNanoseconds;
+    return result;
+}
+
+void BuilderLockScope::resetStatistics()
+{
+    acquisitions = 0;
+    contended = 0;
+    nested = 0;
+    waitedNanoseconds = 0;
+}
+
+}
@@ -0,0 +1,77 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGBUILDERLOCKSCOPE_H
+#define GOLANGBUILDERLOCKSCOPE_H
+
+#include <QtGlobal>
+
+#include "duchain/goduchainexport.h"
+
+namespace go
+{
+
+/**
+ * Holds DUChain write lock over a whole piece of building, like a top level declaration,
+ * so lockers of builders and helpers inside only recurse into it instead of
+ * competing with other parse jobs for the global lock again and again.
+ * Scopes nest, only the outermost one locks DUChain.
+ * Everything done inside a scope has to stay in memory: imports are resolved and package directories
+ * listed before a scope is entered, lookups inside only read DUChain and tables built from it.
+ **/
+class KDEVGODUCHAIN_EXPORT BuilderLockScope
+{
+public:
+    /**
+     * Counters of scopes, either of all threads or of a single one.
+     **/
+    struct Statistics
+    {
+        quint64 acquisitions; //outermost scopes, which locked DUChain
+        quint64 contended; //acquisitions which had to wait for other threads
+        quint64 nested; //scopes entered with lock already held
+        qint64 waitedNanoseconds;
+
+        /**
+         * Counts of scopes entered after @p start was taken.
+         **/
+        Statistics since(const Statistics& start) const;
+    };
+
+    BuilderLockScope();
+    ~BuilderLockScope();
+
+    /**
+     * Counters of all threads since last reset.
+     **/
+    static Statistics statistics();
+    static void resetStatistics();
+
+    /**
+     * Counters of current thread only, never reset. A parse job takes them when it starts
+     * and reports the difference, which other jobs running at the same time don't add to.
+     **/
+    static Statistics threadStatistics();
+
+private:
+    bool m_locked;
+};
+
+}
+
+#endif
@@ -19,7 +19,9 @@
 #include <language/duchain/types/delayedtype.h>
 
 #include "contextbuilder.h"
+#include "builderlockscope.h"
 #include "goducontext.h"
+#include "goparsingenvironmentfile.h"
 #include "duchaindebug.h"
 
 using namespace KDevelop;
@@ -65,12 +67,18 @@ KDevelop::QualifiedIdentifier ContextBuilder::identifierForNode(go::IdentifierAs
 {
     if(!node)
 	return QualifiedIdentifier();
-    return QualifiedIdentifier(m_session->symbol(node->id));
+    return QualifiedIdentifier(m_session->identifier(node->id));
 }
 
 KDevelop::QualifiedIdentifier ContextBuilder::identifierForIndex(qint64 index)
 {
-    return QualifiedIdentifier(m_session->symbol(index));
+    return QualifiedIdentifier(m_session->identifier(index));
+}
+
+bool ContextBuilder::isBlankIdentifier(go::IdentifierAst* node)
+{
+    static const Identifier blank("_");
+    return node && m_session->identifier(node->id) == blank;
 }
 
 void ContextBuilder::setContextOnNode(go::AstNode* node, KDevelop::DUContext* context)
@@ -88,7 +96,7 @@ TopDUContext* ContextBuilder::newTopContext(const RangeInRevision& range, Parsin
 {
     
     if (!file) {
-        file = new ParsingEnvironmentFile(m_session->currentDocument());
+        file = new go::GoParsingEnvironmentFile(m_session->currentDocument());
         file->setLanguage(m_session->languageString());
     }
     //return ContextBuilderBase::newTopContext(range, file);
@@ -120,6 +128,13 @@ go::IdentifierAst* ContextBuilder::identifierAstFromExpressionAst(go::Expression
 }
 
 
+void ContextBuilder::visitTopLevelDeclaration(go::TopLevelDeclarationAst* node)
+{
+    //builders lock DUChain for almost every step, so lock it once per declaration
+    go::BuilderLockScope lock;
+    go::DefaultVisitor::visitTopLevelDeclaration(node);
+}
+
 void ContextBuilder::visitIfStmt(go::IfStmtAst* node)
 {
     //we need variables, declared in if pre-condition(if any) be available in if-block
@@ -57,6 +57,11 @@ public:
             = KDevelop::ReferencedTopDUContext());*/
     
     virtual void startVisiting(go::AstNode* node);
+
+    /**
+     * Holds DUChain lock while top level declaration is built, see BuilderLockScope.
+     **/
+    virtual void visitTopLevelDeclaration(go::TopLevelDeclarationAst* node);
     virtual void visitIfStmt(go::IfStmtAst* node);
     virtual void visitBlock(go::BlockAst* node);
   
@@ -70,6 +75,11 @@ public:
     virtual KDevelop::QualifiedIdentifier identifierForNode(go::IdentifierAst* node);
   
     KDevelop::QualifiedIdentifier identifierForIndex(qint64 index); 
+
+    /**
+     * Checks if @p node is the blank identifier "_", which never declares anything.
+     **/
+    bool isBlankIdentifier(go::IdentifierAst* node);
    
     void setParseSession(ParseSession* session);
     
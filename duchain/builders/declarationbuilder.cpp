@@ -17,6 +17,7 @@
 *************************************************************************************/
 
 #include "declarationbuilder.h"
+#include "builderlockscope.h"
 
 #include <language/duchain/duchainlock.h>
 #include <language/duchain/duchain.h>
@@ -31,12 +32,13 @@
 
 #include "expressionvisitor.h"
 #include "helper.h"
+#include "packagesymboltable.h"
 #include "duchaindebug.h"
 
 using namespace KDevelop;
 
 
-DeclarationBuilder::DeclarationBuilder(ParseSession* session, bool forExport) : m_export(forExport), m_preBuilding(false), m_lastTypeComment(), m_lastConstComment()
+DeclarationBuilder::DeclarationBuilder(ParseSession* session, bool forExport) : m_export(forExport), m_hasPackageContexts(false), m_preBuilding(false), m_forwardDeclared(false), m_lastTypeComment(), m_lastConstComment()
 {
     setParseSession(session);
 }
@@ -44,18 +46,35 @@ DeclarationBuilder::DeclarationBuilder(ParseSession* session, bool forExport) :
 KDevelop::ReferencedTopDUContext DeclarationBuilder::build(const KDevelop::IndexedString& url, go::AstNode* node, KDevelop::ReferencedTopDUContext updateContext)
 {
   qCDebug(DUCHAIN) << "DeclarationBuilder start";
-  if(!m_preBuilding)
-  {
-      qCDebug(DUCHAIN) << "Running prebuilder";
-      DeclarationBuilder preBuilder(m_session, m_export);
-      preBuilder.m_preBuilding = true;
-      updateContext = preBuilder.build(url, node, updateContext);
-  }
+  if(!m_preBuilding && !m_forwardDeclared)
+      updateContext = forwardDeclare(url, node, updateContext);
   return DeclarationBuilderBase::build(url, node, updateContext);
 }
 
+ReferencedTopDUContext DeclarationBuilder::forwardDeclare(const IndexedString& url, go::AstNode* node, ReferencedTopDUContext updateContext)
+{
+    //forward declaration pass: top level types, signatures, variables and constants, without bodies and comments,
+    //so the real pass can resolve names declared later in file
+    qCDebug(DUCHAIN) << "Running prebuilder";
+    DeclarationBuilder preBuilder(m_session, m_export);
+    preBuilder.m_preBuilding = true;
+    if(m_hasPackageContexts)
+        preBuilder.setPackageContexts(m_packageContexts);
+    m_forwardDeclared = true;
+    return preBuilder.build(url, node, updateContext);
+}
+
+void DeclarationBuilder::setPackageContexts(const QList<ReferencedTopDUContext>& contexts)
+{
+    m_hasPackageContexts = true;
+    m_packageContexts = contexts;
+}
+
 void DeclarationBuilder::startVisiting(go::AstNode* node)
 {
+    //imports are about to be linked anew
+    go::PackageSymbolTable::invalidate(document());
+    go::LookupCache::invalidate(topContext());
     {
         DUChainWriteLocker lock;
         topContext()->clearImportedParentContexts();
@@ -65,6 +84,23 @@ void DeclarationBuilder::startVisiting(go::AstNode* node)
     return DeclarationBuilderBase::startVisiting(node);
 }
 
+void DeclarationBuilder::closeDeclaration()
+{
+    //declaration is visible in its context and every context nested in it
+    DUContext* context = currentContext();
+    Identifier name = currentDeclaration() ? currentDeclaration()->identifier() : Identifier();
+    DeclarationBuilderBase::closeDeclaration();
+    go::LookupCache::invalidate(context, name);
+}
+
+void DeclarationBuilder::closeContext()
+{
+    //closing context cleans up declarations and child contexts which weren't encountered again
+    DUContext* context = currentContext();
+    DeclarationBuilderBase::closeContext();
+    go::LookupCache::invalidate(context);
+}
+
 void DeclarationBuilder::visitVarSpec(go::VarSpecAst* node)
 {
     if(node->type)
@@ -88,7 +124,7 @@ void DeclarationBuilder::declareVariablesWithType(go::IdentifierAst* id, go::IdL
     if(!lastType())
 	injectType(AbstractType::Ptr(new IntegralType(IntegralType::TypeNone)));
     lastType()->setModifiers(declareConstant ? AbstractType::ConstModifier : AbstractType::NoModifiers);
-    if(identifierForNode(id).toString() != "_")
+    if(!isBlankIdentifier(id))
     {
         declareVariable(id, lastType());
     }
@@ -99,7 +135,7 @@ void DeclarationBuilder::declareVariablesWithType(go::IdentifierAst* id, go::IdL
 	auto iter = idList->idSequence->front(), end = iter;
 	do
 	{
-            if(identifierForNode(iter->element).toString() != "_")
+            if(!isBlankIdentifier(iter->element))
             {
                 declareVariable(iter->element, lastType());
             }
@@ -146,7 +182,7 @@ void DeclarationBuilder::declareVariables(go::IdentifierAst* id, go::IdListAst*
     if(declareConstant)
 	m_constAutoTypes = types;
 
-    if(identifierForNode(id).toString() != "_")
+    if(!isBlankIdentifier(id))
     {
         declareVariable(id, types.first());
     }
@@ -159,7 +195,7 @@ void DeclarationBuilder::declareVariables(go::IdentifierAst* id, go::IdListAst*
 	{
 	    if(typeIndex >= types.size()) //not enough types to declare all variables
 		return;
-            if(identifierForNode(iter->element).toString() != "_")
+            if(!isBlankIdentifier(iter->element))
             {
                 declareVariable(iter->element, types.at(typeIndex));
             }
@@ -185,9 +221,12 @@ void DeclarationBuilder::declareVariable(go::IdentifierAst* id, const AbstractTy
 void DeclarationBuilder::visitConstDecl(go::ConstDeclAst* node)
 {
     m_constAutoTypes.clear();
-    m_lastConstComment = m_session->commentBeforeToken(node->startToken);
-    //adding const declaration code, just like in GoDoc
-    m_lastConstComment.append(m_session->textForNode(node).toUtf8());
+    if(!m_preBuilding)
+    {
+        m_lastConstComment = m_session->commentBeforeToken(node->startToken);
+        //adding const declaration code, just like in GoDoc
+        m_lastConstComment.append(m_session->textForNode(node).toUtf8());
+    }
     go::DefaultVisitor::visitConstDecl(node);
     m_lastConstComment = QByteArray();
 }
@@ -230,7 +269,15 @@ void DeclarationBuilder::visitConstSpec(go::ConstSpecAst* node)
 
 void DeclarationBuilder::visitFuncDeclaration(go::FuncDeclarationAst* node)
 {
-    go::GoFunctionDeclaration* decl = parseSignature(node->signature, true, node->funcName, m_session->commentBeforeToken(node->startToken-1));
+    QByteArray comment = m_preBuilding ? QByteArray() : m_session->commentBeforeToken(node->startToken-1);
+    go::GoFunctionDeclaration* decl = parseSignature(node->signature, true, node->funcName, comment);
+    if(m_preBuilding)
+    {//forward declarations only need signatures
+        keepBodyContext(decl, node, node->body, node->funcName);
+        return;
+    }
+    if(!node->body && m_session->isBodyReused(node) && !reuseSkippedBody(decl, node, node->funcName))
+        node->body = m_session->parseReusedBody(node);
     if(!node->body)
 	return;
     //a context will be opened when visiting block, but we still open another one here
@@ -254,6 +301,65 @@ void DeclarationBuilder::visitFuncDeclaration(go::FuncDeclarationAst* node)
     closeContext(); //body wrapper context
 }
 
+bool DeclarationBuilder::reuseBodyContext(go::GoFunctionDeclaration* decl, const RangeInRevision& range, go::IdentifierAst* name,
+                                          const RangeInRevision& previousRange)
+{
+    QualifiedIdentifier id = identifierForNode(name);
+    DUChainWriteLocker lock;
+    for(DUContext* context : currentContext()->childContexts())
+    {
+        //body wrapper context, see visitFuncDeclaration
+        if(context->type() != DUContext::Function || context->localScopeIdentifier() != id
+            || context->childContexts().size() != 1 || wasEncountered(context))
+            continue;
+        if(context->range() != range)
+        {
+            if(!previousRange.isValid() || context->range() != previousRange)
+                continue;
+            //body text is unchanged, so only lines above it were added or removed
+            moveContext(context, previousRange.start, range.start);
+        }
+        setEncountered(context);
+        decl->setInternalFunctionContext(context->childContexts().first());
+        decl->setKind(Declaration::Instance);
+        return true;
+    }
+    return false;
+}
+
+bool DeclarationBuilder::reuseSkippedBody(go::GoFunctionDeclaration* decl, go::AstNode* function, go::IdentifierAst* name)
+{
+    return reuseBodyContext(decl, m_session->reusedBodyRange(function), name, m_session->previousBodyRange(function));
+}
+
+void DeclarationBuilder::moveContext(DUContext* context, const CursorInRevision& from, const CursorInRevision& to)
+{
+    //only the first line of moved text can change its column
+    auto move = [&from, &to](const CursorInRevision& cursor) {
+        if(cursor.line == from.line)
+            return CursorInRevision(to.line, cursor.column - from.column + to.column);
+        return CursorInRevision(cursor.line - from.line + to.line, cursor.column);
+    };
+    auto moveRange = [&move](const RangeInRevision& range) {
+        return RangeInRevision(move(range.start), move(range.end));
+    };
+    context->setRange(moveRange(context->range()));
+    for(Declaration* declaration : context->localDeclarations())
+        declaration->setRange(moveRange(declaration->range()));
+    for(int i = 0; i < context->usesCount(); ++i)
+        context->changeUseRange(i, moveRange(context->uses()[i].m_range));
+    for(DUContext* child : context->childContexts())
+        moveContext(child, from, to);
+}
+
+void DeclarationBuilder::keepBodyContext(go::GoFunctionDeclaration* decl, go::AstNode* function, go::BlockAst* body, go::IdentifierAst* name)
+{
+    if(body)
+        reuseBodyContext(decl, editorFindRange(body, body), name);
+    else if(m_session->isBodyReused(function))
+        reuseSkippedBody(decl, function, name);
+}
+
 void DeclarationBuilder::visitMethodDeclaration(go::MethodDeclarationAst* node)
 {
     Declaration* declaration=0;
@@ -272,54 +378,64 @@ void DeclarationBuilder::visitMethodDeclaration(go::MethodDeclarationAst* node)
 	openContext(node, editorFindRange(node, 0), DUContext::Namespace, identifierForNode(actualtype));
 	declaration->setInternalContext(currentContext());
     }
-    go::GoFunctionDeclaration* decl = parseSignature(node->signature, true, node->methodName, m_session->commentBeforeToken(node->startToken-1));
+    QByteArray comment = m_preBuilding ? QByteArray() : m_session->commentBeforeToken(node->startToken-1);
+    go::GoFunctionDeclaration* decl = parseSignature(node->signature, true, node->methodName, comment);
     
-    if(!node->body)
-	return;
+    //body can be missing either in declaration of external method or in declarations-only parse
+    if(m_preBuilding)
+        keepBodyContext(decl, node, node->body, node->methodName);
+    else if(!node->body && m_session->isBodyReused(node) && !reuseSkippedBody(decl, node, node->methodName))
+        node->body = m_session->parseReusedBody(node);
+    if(node->body && !m_preBuilding)
+    {
+        DUContext* bodyContext = openContext(node->body, DUContext::ContextType::Function, node->methodName);
+
+        {//import parameters into body context
+            DUChainWriteLocker lock;
+            if(decl->internalContext())
+                currentContext()->addImportedParentContext(decl->internalContext());
+            if(decl->returnArgsContext())
+                currentContext()->addImportedParentContext(decl->returnArgsContext());
+        }
 
-    DUContext* bodyContext = openContext(node->body, DUContext::ContextType::Function, node->methodName);
+        if(node->methodRecv->type)
+        {//declare method receiver variable('this' or 'self' analog in Go)
+            buildTypeName(node->methodRecv->type);
+            if(node->methodRecv->star!= -1)
+            {
+                PointerType* ptype = new PointerType();
+                ptype->setBaseType(lastType());
+                injectType(PointerType::Ptr(ptype));
+            }
+            DUChainWriteLocker n;
+            Declaration* thisVariable = openDeclaration<Declaration>(identifierForNode(node->methodRecv->nameOrType), editorFindRange(node->methodRecv->nameOrType, 0));
+            thisVariable->setAbstractType(lastType());
+            closeDeclaration();
+        }
 
-    {//import parameters into body context
-        DUChainWriteLocker lock;
-        if(decl->internalContext())
-            currentContext()->addImportedParentContext(decl->internalContext());
-        if(decl->returnArgsContext())
-            currentContext()->addImportedParentContext(decl->returnArgsContext());
-    }
-    
-    if(node->methodRecv->type)
-    {//declare method receiver variable('this' or 'self' analog in Go)
-        buildTypeName(node->methodRecv->type);
-	if(node->methodRecv->star!= -1)
-	{
-	    PointerType* ptype = new PointerType();
-	    ptype->setBaseType(lastType());
-	    injectType(PointerType::Ptr(ptype));
-	}
-	DUChainWriteLocker n;
-	Declaration* thisVariable = openDeclaration<Declaration>(identifierForNode(node->methodRecv->nameOrType), editorFindRange(node->methodRecv->nameOrType, 0));
-	thisVariable->setAbstractType(lastType());
-	closeDeclaration();
+        visitBlock(node->body);
+        {
+            DUChainWriteLocker lock;
+            lastContext()->setType(DUContext::Function);
+            decl->setInternalFunctionContext(lastContext()); //inner block context
+            decl->setKind(Declaration::Instance);
+        }
+
+        closeContext(); //body wrapper context
     }
-	
-    visitBlock(node->body);
+
+    if(node->methodRecv)
     {
-	DUChainWriteLocker lock;
-        lastContext()->setType(DUContext::Function);
-	decl->setInternalFunctionContext(lastContext()); //inner block context
-	decl->setKind(Declaration::Instance);
+        closeContext();	//namespace
+        closeDeclaration();	//namespace declaration
     }
-    
-    closeContext(); //body wrapper context
-    closeContext();	//namespace
-    closeDeclaration();	//namespace declaration
 }
 
 void DeclarationBuilder::visitTypeSpec(go::TypeSpecAst* node)
 {
     //first try setting comment before type name
     //if it doesn't exists, set comment before type declaration
-    QByteArray comment = m_session->commentBeforeToken(node->startToken);
+    QByteArray comment = m_preBuilding ? QByteArray() : m_session->commentBeforeToken(node->startToken);
     if(comment.size() == 0)
         comment = m_lastTypeComment;
     setComment(comment);
@@ -352,13 +468,18 @@ void DeclarationBuilder::visitImportSpec(go::ImportSpecAst* node)
     //if(m_export)
 	//return;
     QString import(identifierForIndex(node->importpath->import).toString());
-    QList<ReferencedTopDUContext> contexts = m_session->contextForImport(import);
+    QString realName, directory;
+    QList<ReferencedTopDUContext> contexts = m_session->contextForImport(import, &realName, &directory);
     if(contexts.empty())
 	return;
+    //lookups read only DUChain, so files of package are listed while it isn't locked
+    go::PackageSymbolTable::preparePackage(directory);
  
-    //usually package name matches directory, so try searching for that first
-    QualifiedIdentifier packageName(import.mid(1, import.length()-2));
+    //package name is known from preambles, otherwise it usually matches directory, so try searching for that first
+    QualifiedIdentifier packageName(realName.isEmpty() ? import.mid(1, import.length()-2) : realName);
     bool firstContext = true;
+    //contexts are ready and package is listed by now, so link all of them under a single lock without touching disk
+    go::BuilderLockScope lock;
     for(const ReferencedTopDUContext& context : contexts)
     {
         //don't import itself
@@ -370,13 +491,11 @@ void DeclarationBuilder::visitImportSpec(go::ImportSpecAst* node)
             decl = go::getFirstDeclaration(context); //package name differs from directory, so get the real name
             if(!decl)
                 continue;
-            DUChainReadLocker lock;
             packageName = decl->qualifiedIdentifier();
         }
         if(!decl) //contexts belongs to a different package
             continue;
 	
-        DUChainWriteLocker lock;
         if(firstContext) //only open declarations once per import(others are redundant)
         {
             setComment(decl->comment());
@@ -404,13 +523,14 @@ void DeclarationBuilder::visitImportSpec(go::ImportSpecAst* node)
 	topContext()->addImportedParentContext(context.data());
         firstContext = false;
     }
-    DUChainWriteLocker lock;
     topContext()->updateImportsCache();
+    go::LookupCache::invalidate(topContext());
 }
 
 void DeclarationBuilder::visitSourceFile(go::SourceFileAst* node)
 {
-    setComment(m_session->commentBeforeToken(node->startToken));
+    if(!m_preBuilding)
+        setComment(m_session->commentBeforeToken(node->startToken));
     DUChainWriteLocker lock;
     Declaration* packageDeclaration = openDeclaration<Declaration>(identifierForNode(node->packageClause->packageName), editorFindRange(node->packageClause->packageName, 0));
     packageDeclaration->setKind(Declaration::Namespace);
@@ -429,7 +549,7 @@ void DeclarationBuilder::visitSourceFile(go::SourceFileAst* node)
 
 void DeclarationBuilder::importThisPackage()
 {
-    QList<ReferencedTopDUContext> contexts = m_session->contextForThisPackage(document());
+    QList<ReferencedTopDUContext> contexts = m_hasPackageContexts ? m_packageContexts : m_session->contextForThisPackage(document(), m_thisPackage.last().toString());
     if(contexts.empty())
 	return;
     
@@ -456,6 +576,7 @@ void DeclarationBuilder::importThisPackage()
     }
     DUChainWriteLocker lock;
     topContext()->updateImportsCache();
+    go::LookupCache::invalidate(topContext());
 }
 
 void DeclarationBuilder::visitForStmt(go::ForStmtAst* node)
@@ -569,7 +690,8 @@ void DeclarationBuilder::visitCommClause(go::CommClauseAst* node)
 
 void DeclarationBuilder::visitTypeDecl(go::TypeDeclAst* node)
 {
-    m_lastTypeComment = m_session->commentBeforeToken(node->startToken);
+    if(!m_preBuilding)
+        m_lastTypeComment = m_session->commentBeforeToken(node->startToken);
     go::DefaultVisitor::visitTypeDecl(node);
     m_lastTypeComment = QByteArray();
 }
@@ -41,6 +41,33 @@ public:
                                                    KDevelop::ReferencedTopDUContext updateContext = KDevelop::ReferencedTopDUContext());
     virtual void startVisiting(go::AstNode* node);
 
+    /**
+     * Runs only the forward declaration pass, which build() otherwise starts with.
+     * When all files of a package are built together, each of them is forward declared first,
+     * so build() of every file finds top level symbols of the others and runs once.
+     **/
+    KDevelop::ReferencedTopDUContext forwardDeclare(const KDevelop::IndexedString& url, go::AstNode* node,
+                                                    KDevelop::ReferencedTopDUContext updateContext = KDevelop::ReferencedTopDUContext());
+
+    /**
+     * Links @p contexts as other files of this package, instead of looking them up in session.
+     * Used when all files of a package are built together, an empty list links nothing.
+     */
+    void setPackageContexts(const QList<KDevelop::ReferencedTopDUContext>& contexts);
+
+    /**
+     * Whether expressions resolved by this builder should be remembered in session for UseBuilder.
+     * Forward declaration pass and builds for export are followed by no use building.
+     */
+    bool recordsUses() const { return !m_preBuilding && !m_export; }
+
+    /**
+     * Both change what identifiers resolve to, so lookups cached during build which can see
+     * the closed declaration, or were done inside the closed context, are dropped.
+     */
+    virtual void closeDeclaration() override;
+    virtual void closeContext() override;
+
     virtual void visitVarSpec(go::VarSpecAst* node);
     virtual void visitShortVarDecl(go::ShortVarDeclAst* node);
     virtual void visitConstSpec(go::ConstSpecAst* node);
@@ -99,12 +126,40 @@ private:
     virtual go::GoFunctionDeclaration* declareFunction(go::IdentifierAst* id, const go::GoFunctionType::Ptr& type,
                                                        DUContext* paramContext, DUContext* retparamContext, const QByteArray& comment=QByteArray()) override;
 
+    /**
+     * Keeps body context of a function with body at @p range from existing DUChain.
+     * Context still at @p previousRange is moved to @p range together with everything inside it.
+     * Returns false if there is no such context, then body has to be parsed and built after all.
+     **/
+    bool reuseBodyContext(go::GoFunctionDeclaration* decl, const KDevelop::RangeInRevision& range, go::IdentifierAst* name,
+                          const KDevelop::RangeInRevision& previousRange = KDevelop::RangeInRevision::invalid());
+
+    /**
+     * Keeps body context of @p function, skipped by parser as unchanged.
+     **/
+    bool reuseSkippedBody(go::GoFunctionDeclaration* decl, go::AstNode* function, go::IdentifierAst* name);
+
+    /**
+     * Moves ranges of @p context, its declarations, uses and child contexts, so that @p from becomes @p to.
+     * DUChain has to be locked for writing.
+     **/
+    static void moveContext(KDevelop::DUContext* context, const KDevelop::CursorInRevision& from, const KDevelop::CursorInRevision& to);
+
+    /**
+     * Forward declaration pass doesn't build bodies, this keeps body context of @p function
+     * from previous build, so the real pass updates it instead of creating a new one.
+     **/
+    void keepBodyContext(go::GoFunctionDeclaration* decl, go::AstNode* function, go::BlockAst* body, go::IdentifierAst* name);
+
     void importThisPackage();
     bool m_export;
+    bool m_hasPackageContexts;
+    QList<KDevelop::ReferencedTopDUContext> m_packageContexts;
     
     //QHash<QString, TopDUContext*> m_anonymous_imports;
     
     bool m_preBuilding;
+    bool m_forwardDeclared;
     QList<AbstractType::Ptr> m_constAutoTypes;
     QualifiedIdentifier m_thisPackage;
     QualifiedIdentifier m_switchTypeVariable;
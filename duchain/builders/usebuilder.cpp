@@ -27,7 +27,7 @@ using namespace KDevelop;
 namespace go 
 {
     
-UseBuilder::UseBuilder(ParseSession* session)
+UseBuilder::UseBuilder(ParseSession* session) : m_mappedExpressions(0), m_resolvedExpressions(0)
 {
     setParseSession(session);
 }
@@ -58,6 +58,16 @@ void UseBuilder::visitTypeName(TypeNameAst* node)
 
 void UseBuilder::visitPrimaryExpr(PrimaryExprAst* node)
 {
+    //DeclarationBuilder already resolved expressions it deduced types from
+    SimpleUses uses;
+    if(m_session->mappedUses(node, &uses) && !hasDeletedDeclarations(uses))
+    {
+        m_mappedExpressions++;
+        for(const auto& use : uses)
+            newUse(use.first, use.second);
+        go::DefaultVisitor::visitPrimaryExpr(node);
+        return;
+    }
     DUContext* context;
     {
 	DUChainReadLocker lock;
@@ -65,6 +75,7 @@ void UseBuilder::visitPrimaryExpr(PrimaryExprAst* node)
 	context = currentContext()->findContextIncluding(editorFindRange(node, 0));
     }
     if(!context) return;
+    m_resolvedExpressions++;
     ExpressionVisitor visitor(m_session, context);
     visitor.visitPrimaryExpr(node);
     auto ids = visitor.allIds();
@@ -77,6 +88,17 @@ void UseBuilder::visitPrimaryExpr(PrimaryExprAst* node)
     go::DefaultVisitor::visitPrimaryExpr(node);
 }
 
+bool UseBuilder::hasDeletedDeclarations(const SimpleUses& uses)
+{
+    DUChainReadLocker lock;
+    for(const auto& use : uses)
+    {
+        if(!use.second)
+            return true;
+    }
+    return false;
+}
+
 void UseBuilder::visitBlock(BlockAst* node)
 {
     go::DefaultVisitor::visitBlock(node);
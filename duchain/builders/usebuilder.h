@@ -41,9 +41,23 @@ public:
     virtual void visitPrimaryExpr(go::PrimaryExprAst* node);
     virtual void visitTypeName(go::TypeNameAst* node);
     virtual void visitBlock(go::BlockAst* node);
+
+    /**
+     * Primary expressions whose uses were taken from DeclarationBuilder and those resolved again.
+     **/
+    int mappedExpressions() const { return m_mappedExpressions; }
+    int resolvedExpressions() const { return m_resolvedExpressions; }
     
 private:
+    /**
+     * Declarations resolved by DeclarationBuilder may have been cleaned up by the end of its pass,
+     * then expression has to be resolved again.
+     **/
+    bool hasDeletedDeclarations(const SimpleUses& uses);
+
     QStack<KDevelop::AbstractType::Ptr> m_types;
+    int m_mappedExpressions;
+    int m_resolvedExpressions;
     
 };
     
@@ -0,0 +1,194 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "canonicalimportindex.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QMutex>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+
+#include "parser/preamble.h"
+#include "duchaindebug.h"
+
+namespace go
+{
+
+namespace
+{
+
+const quint32 indexMagic = 0x676f6369;
+const quint32 indexVersion = 2;
+
+/**
+ * Indexes every directory of the subtree it is given. Files which weren't modified
+ * since previous update keep their canonical imports without being read.
+ **/
+class WalkJob : public QRunnable
+{
+public:
+    WalkJob(const QString& root, const QHash<QString, CanonicalImportIndex::Directory>& previous,
+            QMutex* mutex, QHash<QString, CanonicalImportIndex::Directory>* result)
+        : m_root(root), m_previous(previous), m_mutex(mutex), m_result(result)
+    {
+    }
+
+    virtual void run() override
+    {
+        QHash<QString, CanonicalImportIndex::Directory> found;
+        visit(m_root, found);
+        QDirIterator iterator(m_root, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while(iterator.hasNext())
+            visit(iterator.next(), found);
+        QMutexLocker lock(m_mutex);
+        m_result->unite(found);
+    }
+
+private:
+    void visit(const QString& path, QHash<QString, CanonicalImportIndex::Directory>& found)
+    {
+        QHash<QString, CanonicalImportIndex::File> previous = m_previous.value(path).files;
+        CanonicalImportIndex::Directory directory;
+        QDir dir(path);
+        //files are checked in the same order every time, the first one with canonical import wins
+        for(const QFileInfo& info : dir.entryInfoList(QStringList("*.go"), QDir::Files | QDir::NoSymLinks, QDir::Name))
+        {
+            CanonicalImportIndex::File file{info.lastModified().toMSecsSinceEpoch(), info.size(), QString()};
+            auto known = previous.constFind(info.fileName());
+            if(known != previous.constEnd() && known->modified == file.modified && known->size == file.size)
+                file.canonicalImport = known->canonicalImport;
+            else
+                file.canonicalImport = Preamble::read(info.filePath()).canonicalImport;
+            directory.files.insert(info.fileName(), file);
+            if(!file.canonicalImport.isEmpty())
+            {
+                directory.canonicalImport = file.canonicalImport;
+                qCDebug(DUCHAIN) << "Found canonical import for package " << path << " import: " << directory.canonicalImport;
+                break;
+            }
+        }
+        found.insert(path, directory);
+    }
+
+    QString m_root;
+    const QHash<QString, CanonicalImportIndex::Directory>& m_previous;
+    QMutex* m_mutex;
+    QHash<QString, CanonicalImportIndex::Directory>* m_result;
+};
+
+}
+
+CanonicalImportIndex::CanonicalImportIndex(const QString& indexFile) : m_indexFile(indexFile)
+{
+}
+
+QString CanonicalImportIndex::defaultIndexFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/kdevgo/canonicalimports";
+}
+
+bool CanonicalImportIndex::load()
+{
+    m_directories.clear();
+    QFile file(m_indexFile);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream stream(&file);
+    quint32 magic, version, count;
+    stream >> magic >> version >> count;
+    if(stream.status() != QDataStream::Ok || magic != indexMagic || version != indexVersion)
+        return false;
+    m_directories.reserve(count);
+    for(quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+    {
+        QString path;
+        Directory directory;
+        quint32 files;
+        stream >> path >> directory.canonicalImport >> files;
+        for(quint32 j = 0; j < files && stream.status() == QDataStream::Ok; ++j)
+        {
+            QString name;
+            File file;
+            stream >> name >> file.modified >> file.size >> file.canonicalImport;
+            directory.files.insert(name, file);
+        }
+        m_directories.insert(path, directory);
+    }
+    if(stream.status() != QDataStream::Ok)
+    {//truncated index is useless, everything will be reindexed
+        m_directories.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CanonicalImportIndex::save() const
+{
+    QDir().mkpath(QFileInfo(m_indexFile).absolutePath());
+    QSaveFile file(m_indexFile);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream stream(&file);
+    stream << indexMagic << indexVersion << quint32(m_directories.size());
+    for(auto iter = m_directories.constBegin(); iter != m_directories.constEnd(); ++iter)
+    {
+        stream << iter.key() << iter->canonicalImport << quint32(iter->files.size());
+        for(auto file = iter->files.constBegin(); file != iter->files.constEnd(); ++file)
+            stream << file.key() << file->modified << file->size << file->canonicalImport;
+    }
+    return file.commit();
+}
+
+void CanonicalImportIndex::update(const QStringList& searchPaths)
+{
+    QHash<QString, Directory> result;
+    QMutex mutex;
+    QThreadPool pool;
+    //every top level directory of search path is walked by its own job
+    for(const QString& searchPath : searchPaths)
+    {
+        QDir dir(searchPath);
+        for(const QString& child : dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+            pool.start(new WalkJob(dir.filePath(child), m_directories, &mutex, &result));
+    }
+    pool.waitForDone();
+    m_directories.swap(result);
+}
+
+QHash<QString, QString> CanonicalImportIndex::imports() const
+{
+    QHash<QString, QString> imports;
+    QStringList paths = m_directories.keys();
+    //if several packages claim the same import, the same one wins every time
+    paths.sort();
+    for(const QString& path : paths)
+    {
+        const QString& canonicalImport = m_directories[path].canonicalImport;
+        if(!canonicalImport.isEmpty() && !imports.contains(canonicalImport))
+            imports.insert(canonicalImport, path);
+    }
+    return imports;
+}
+
+}
@@ -0,0 +1,86 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGCANONICALIMPORTINDEX_H
+#define GOLANGCANONICALIMPORTINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+#include "goduchainexport.h"
+
+namespace go
+{
+
+/**
+ * Maps canonical import paths to package directories. A package declares its canonical import
+ * with a comment like ` package pack // import "my_pack" `, and then it must be imported as my_pack.
+ * Index is kept on disk between sessions. Files are stored with their modification times and sizes,
+ * so update() only reads files which were added or changed since they were indexed.
+ * Only preambles of files are read, see Preamble::read().
+ **/
+class KDEVGODUCHAIN_EXPORT CanonicalImportIndex
+{
+public:
+    /**
+     * @param indexFile where index is stored, see load() and save()
+     **/
+    explicit CanonicalImportIndex(const QString& indexFile);
+
+    /**
+     * Default location of index file in user's cache directory.
+     **/
+    static QString defaultIndexFile();
+
+    bool load();
+
+    bool save() const;
+
+    /**
+     * Walks @p searchPaths on a thread pool, reindexing changed directories and forgetting removed ones.
+     **/
+    void update(const QStringList& searchPaths);
+
+    /**
+     * Canonical import path mapped to package directory.
+     **/
+    QHash<QString, QString> imports() const;
+
+    struct File
+    {
+        qint64 modified;
+        qint64 size;
+        QString canonicalImport;
+    };
+
+    struct Directory
+    {
+        //files checked up to the first one with canonical import, by name
+        QHash<QString, File> files;
+        QString canonicalImport;
+    };
+
+private:
+    QString m_indexFile;
+    QHash<QString, Directory> m_directories;
+};
+
+}
+
+#endif
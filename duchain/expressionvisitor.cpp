@@ -116,6 +116,41 @@ void ExpressionVisitor::visitUnaryExpression(UnaryExpressionAst* node)
 }
 
 void ExpressionVisitor::visitPrimaryExpr(PrimaryExprAst* node)
+{
+    //without builder evaluation has no side effects, so its result depends only on node and context
+    //as long as there are no types left from previous expressions
+    bool memoizable = !m_builder && m_types.isEmpty();
+    MemoizedExpression result;
+    if(memoizable && m_session->memoizedExpression(node, m_context, &result))
+    {
+        for(const auto& use : result.uses)
+        {
+            m_ids.append(use.first);
+            m_declarations.append(use.second);
+        }
+        m_types = result.types;
+        if(result.setsDeclaration)
+            m_declaration = result.declaration;
+        return;
+    }
+    int firstUse = m_ids.size();
+    DeclarationPointer previousDeclaration = m_declaration;
+    resolvePrimaryExpr(node);
+    for(int i = firstUse; i < m_ids.size(); ++i)
+        result.uses.append(qMakePair(m_ids.at(i), m_declarations.at(i)));
+    //uses are built after declarations, let them know what this expression resolved to
+    if(m_builder && m_builder->recordsUses())
+        m_session->mapAstUse(node, result.uses);
+    else if(memoizable)
+    {
+        result.types = m_types;
+        result.setsDeclaration = m_declaration != previousDeclaration;
+        result.declaration = m_declaration;
+        m_session->memoizeExpression(node, m_context, result);
+    }
+}
+
+void ExpressionVisitor::resolvePrimaryExpr(PrimaryExprAst* node)
 {
     if(node->id)
     {
@@ -581,7 +616,7 @@ QualifiedIdentifier ExpressionVisitor::identifierForNode(IdentifierAst* node)
 {
     if(!node)
 	return QualifiedIdentifier();
-    return QualifiedIdentifier(m_session->symbol(node->id));
+    return QualifiedIdentifier(m_session->identifier(node->id));
 }
 
 bool ExpressionVisitor::handleComplexLiteralsAndConversions(PrimaryExprResolveAst* node, Declaration* decl)
@@ -79,6 +79,11 @@ private:
 
     void pushUse(IdentifierAst* node, Declaration* declaration);
 
+    /**
+     * Does actual work of visitPrimaryExpr, which records resulting uses in session.
+     **/
+    void resolvePrimaryExpr(PrimaryExprAst* node);
+
     AbstractType::Ptr resolveTypeAlias(AbstractType::Ptr type);
 
     QualifiedIdentifier identifierForNode(IdentifierAst* node);
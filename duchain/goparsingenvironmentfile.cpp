@@ -0,0 +1,114 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "goparsingenvironmentfile.h"
+
+#include <language/duchain/duchainregister.h>
+#include <language/duchain/declaration.h>
+#include <language/duchain/topducontext.h>
+
+#include <QCryptographicHash>
+#include <QtEndian>
+
+#include "types/gostructuretype.h"
+
+using namespace KDevelop;
+
+namespace go {
+
+REGISTER_DUCHAIN_ITEM(GoParsingEnvironmentFile);
+
+namespace
+{
+
+bool isExported(Declaration* declaration)
+{
+    QString name = declaration->identifier().toString();
+    return !name.isEmpty() && name[0].isUpper();
+}
+
+QString describeType(const AbstractType::Ptr& type, int depth)
+{
+    if(!type)
+        return QString();
+    GoStructureType::Ptr structure = type.cast<GoStructureType>();
+    //named structures only show their name, fields are what importers depend on
+    if(!structure || !structure->context() || depth > 2)
+        return type->toString();
+    QString description = type->toString() + " {";
+    for(Declaration* field : structure->context()->localDeclarations())
+        description += field->identifier().toString() + " " + describeType(field->abstractType(), depth + 1) + "; ";
+    return description + "}";
+}
+
+void addExport(Declaration* declaration, QStringList& exports)
+{
+    if(!isExported(declaration))
+        return;
+    exports.append(declaration->qualifiedIdentifier().toString() + " " + QString::number(declaration->kind())
+                   + " " + describeType(declaration->abstractType(), 0));
+}
+
+}
+
+GoParsingEnvironmentFile::GoParsingEnvironmentFile(const IndexedString& url) : ParsingEnvironmentFile(*new GoParsingEnvironmentFileData, url)
+{
+    d_func_dynamic()->setClassId(this);
+}
+
+GoParsingEnvironmentFile::GoParsingEnvironmentFile(GoParsingEnvironmentFileData& data) : ParsingEnvironmentFile(data)
+{
+}
+
+quint64 GoParsingEnvironmentFile::exportFingerprint() const
+{
+    return d_func()->m_exportFingerprint;
+}
+
+void GoParsingEnvironmentFile::setExportFingerprint(quint64 fingerprint)
+{
+    d_func_dynamic()->m_exportFingerprint = fingerprint;
+}
+
+quint64 GoParsingEnvironmentFile::fingerprintExports(TopDUContext* context)
+{
+    QStringList exports;
+    for(Declaration* package : context->localDeclarations())
+    {
+        exports.append(package->identifier().toString());
+        if(!package->internalContext())
+            continue;
+        for(Declaration* declaration : package->internalContext()->localDeclarations())
+        {
+            addExport(declaration, exports);
+            //methods are declared in namespace named after receiver type
+            if(declaration->kind() == Declaration::Namespace && declaration->internalContext())
+            {
+                for(Declaration* method : declaration->internalContext()->localDeclarations())
+                    addExport(method, exports);
+            }
+        }
+    }
+    //order of declarations in file doesn't matter to importers
+    exports.sort();
+    QByteArray digest = QCryptographicHash::hash(exports.join('\n').toUtf8(), QCryptographicHash::Sha1);
+    quint64 fingerprint = qFromBigEndian<quint64>(reinterpret_cast<const uchar*>(digest.constData()));
+    return fingerprint ? fingerprint : 1;
+}
+
+}
@@ -0,0 +1,82 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGPARSINGENVIRONMENTFILE_H
+#define GOLANGPARSINGENVIRONMENTFILE_H
+
+#include <language/duchain/parsingenvironment.h>
+
+#include "goduchainexport.h"
+
+namespace KDevelop
+{
+    class TopDUContext;
+}
+
+namespace go {
+
+class GoParsingEnvironmentFileData : public KDevelop::ParsingEnvironmentFileData
+{
+public:
+    GoParsingEnvironmentFileData() : KDevelop::ParsingEnvironmentFileData(), m_exportFingerprint(0)
+    {
+    }
+
+    GoParsingEnvironmentFileData(const GoParsingEnvironmentFileData& rhs) : KDevelop::ParsingEnvironmentFileData(rhs), m_exportFingerprint(rhs.m_exportFingerprint)
+    {
+    }
+
+    quint64 m_exportFingerprint;
+};
+
+/**
+ * Parsing environment of Go files, remembering fingerprint of what the file exports,
+ * so importers only need to be reparsed when it changes.
+ */
+class KDEVGODUCHAIN_EXPORT GoParsingEnvironmentFile : public KDevelop::ParsingEnvironmentFile
+{
+public:
+    GoParsingEnvironmentFile(const KDevelop::IndexedString& url);
+    GoParsingEnvironmentFile(GoParsingEnvironmentFileData& data);
+
+    /**
+     * Returns fingerprint stored with last build, 0 if there is none yet.
+     */
+    quint64 exportFingerprint() const;
+
+    void setExportFingerprint(quint64 fingerprint);
+
+    /**
+     * Hashes names and types of exported declarations of @p context, including methods and fields of
+     * exported structures. Function bodies and unexported declarations don't affect it.
+     * Fingerprint is the first 64 bits of SHA1 of that description, and never 0.
+     * Has to be called with DUChain read lock held.
+     */
+    static quint64 fingerprintExports(KDevelop::TopDUContext* context);
+
+    enum {
+        Identity = 122
+    };
+
+private:
+    DUCHAIN_DECLARE_DATA(GoParsingEnvironmentFile);
+};
+
+}
+
+#endif
@@ -18,17 +18,155 @@
 
 #include "helper.h"
 
+#include <language/duchain/duchain.h>
 #include <language/duchain/duchainlock.h>
 #include <language/duchain/declaration.h>
 #include <language/duchain/topducontext.h>
 
 #include <QReadLocker>
-#include <QProcess>
+#include <QDir>
+
+#include "importenvironment.h"
+#include "packagesymboltable.h"
 
 namespace go
 {
 
-QList<QString> Helper::m_CachedSearchPaths;
+namespace
+{
+
+thread_local LookupCache* currentCache = 0;
+
+/**
+ * Read locks DUChain unless current thread already holds the lock, e.g. inside BuilderLockScope.
+ * Recursive locking would still touch counters of the global lock shared by all threads.
+ */
+class ReadLockUnlessHeld
+{
+public:
+    ReadLockUnlessHeld()
+        : m_locked(!DUChain::lock()->currentThreadHasWriteLock() && !DUChain::lock()->currentThreadHasReadLock())
+    {
+        if(m_locked)
+            DUChain::lock()->lockForRead();
+    }
+
+    ~ReadLockUnlessHeld()
+    {
+        if(m_locked)
+            DUChain::lock()->releaseReadLock();
+    }
+
+private:
+    bool m_locked;
+};
+
+/**
+ * Looks members of imported packages up in merged tables of packages, everything else in @p context.
+ */
+LookupCache::Candidates findDeclarations(const QualifiedIdentifier& id, DUContext* context)
+{
+    QList<Declaration*> declarations;
+    if(!PackageSymbolTable::findImported(id, context, &declarations))
+        declarations = context->findDeclarations(id, CursorInRevision(INT_MAX, INT_MAX));
+    LookupCache::Candidates candidates;
+    for(Declaration* decl : declarations)
+        candidates.append(qMakePair(DeclarationPointer(decl), decl->kind()));
+    return candidates;
+}
+
+}
+
+LookupCache::LookupCache() : m_outer(currentCache), m_hits(0), m_misses(0)
+{
+    currentCache = this;
+}
+
+LookupCache::~LookupCache()
+{
+    currentCache = m_outer;
+}
+
+void LookupCache::invalidate(DUContext* context)
+{
+    if(!currentCache)
+        return;
+    //every lookup which can see context was indexed under it
+    for(const Key& key : currentCache->m_byScope.take(context))
+    {
+        auto iter = currentCache->m_entries.find(key);
+        //context of a dropped lookup may have been deleted and its address reused since
+        if(iter != currentCache->m_entries.end() && iter->scope.contains(context))
+            currentCache->m_entries.erase(iter);
+    }
+}
+
+void LookupCache::invalidate(DUContext* context, const Identifier& name)
+{
+    if(!currentCache)
+        return;
+    auto index = currentCache->m_byName.find(IndexedIdentifier(name));
+    if(index == currentCache->m_byName.end())
+        return;
+    auto affected = [context, &name](const Entry& entry) {
+        if(entry.id.first() == name && entry.scope.contains(context))
+            return true;
+        //members, e.g. methods declared in namespace of their receiver type, are found from anywhere
+        for(int i = 1; i < entry.id.count(); ++i)
+        {
+            if(entry.id.at(i) == name)
+                return true;
+        }
+        return false;
+    };
+    for(auto key = index->begin(); key != index->end();)
+    {
+        auto iter = currentCache->m_entries.find(*key);
+        if(iter == currentCache->m_entries.end() || affected(*iter))
+        {
+            if(iter != currentCache->m_entries.end())
+                currentCache->m_entries.erase(iter);
+            key = index->erase(key);
+        }
+        else
+            ++key;
+    }
+    if(index->isEmpty())
+        currentCache->m_byName.erase(index);
+}
+
+LookupCache::Candidates LookupCache::find(const QualifiedIdentifier& id, DUContext* context)
+{
+    if(!currentCache)
+        return findDeclarations(id, context);
+    auto key = qMakePair(context, IndexedQualifiedIdentifier(id));
+    auto iter = currentCache->m_entries.constFind(key);
+    if(iter != currentCache->m_entries.constEnd())
+    {
+        currentCache->m_hits++;
+        //declarations of other files may have been deleted since
+        Candidates candidates;
+        for(const auto& candidate : iter->candidates)
+        {
+            if(candidate.first)
+                candidates.append(candidate);
+        }
+        return candidates;
+    }
+    currentCache->m_misses++;
+    Entry entry;
+    entry.candidates = findDeclarations(id, context);
+    entry.id = id;
+    for(DUContext* scope = context; scope; scope = scope->parentContext())
+    {
+        entry.scope.append(scope);
+        currentCache->m_byScope[scope].insert(key);
+    }
+    for(int i = 0; i < id.count(); ++i)
+        currentCache->m_byName[IndexedIdentifier(id.at(i))].insert(key);
+    currentCache->m_entries.insert(key, entry);
+    return entry.candidates;
+}
 
 QList< QString > Helper::getSearchPaths(QUrl document)
 {
@@ -44,56 +182,23 @@ QList< QString > Helper::getSearchPaths(QUrl document)
             paths.append(currentDir.absolutePath());
     }
 
-    if(Helper::m_CachedSearchPaths.empty())
-    {
-        //check $GOPATH env var
-        QByteArray result = qgetenv("GOPATH");
-        if(!result.isEmpty())
-        {
-            QDir path(result);
-            if(path.exists() && path.cd("src") && path.exists())
-                m_CachedSearchPaths.append(path.absolutePath());
-        }
-        //then check $GOROOT
-        //these days most people don't set GOROOT manually
-        //instead go tool can find correct value for GOROOT on its own
-        //in order for this to work go exec must be in $PATH
-        QProcess p;
-        p.start("go env GOROOT");
-        p.waitForFinished();
-        result = p.readAllStandardOutput();
-        if(result.endsWith("\n"))
-            result.remove(result.length()-1, 1);
-        if(!result.isEmpty())
-        {
-            //since Go 1.4 stdlib packages are stored in $GOROOT/src/
-            //but we also support old layout $GOROOT/src/pkg/
-            QDir path = QDir(result);
-            if(path.exists() && path.cd("src") && path.exists())
-            {
-                m_CachedSearchPaths.append(path.absolutePath());
-                if(path.cd("pkg") && path.exists())
-                    m_CachedSearchPaths.append(path.absolutePath());
-            }
-        }
-    }
-    paths.append(m_CachedSearchPaths);
+    paths.append(ImportEnvironment::snapshot()->searchPaths);
     return paths;
 }
 
 
 DeclarationPointer getDeclaration(QualifiedIdentifier id, DUContext* context, bool searchInParent)
 {
-    DUChainReadLocker lock;
+    ReadLockUnlessHeld lock;
     if(context)
     {
-	auto declarations = context->findDeclarations(id, CursorInRevision(INT_MAX, INT_MAX));
-	for(Declaration* decl: declarations)
+	auto declarations = LookupCache::find(id, context);
+	for(const auto& decl: declarations)
 	{
 	    //import declarations are just decorations and need not be returned
-	    if(decl->kind() == Declaration::Import)
+	    if(decl.second == Declaration::Import)
 		continue;
-	    return DeclarationPointer(decl);
+	    return decl.first;
 	}
     }
     return DeclarationPointer();
@@ -101,15 +206,15 @@ DeclarationPointer getDeclaration(QualifiedIdentifier id, DUContext* context, bo
 
 DeclarationPointer getTypeOrVarDeclaration(QualifiedIdentifier id, DUContext* context, bool searchInParent)
 {
-    DUChainReadLocker lock;
+    ReadLockUnlessHeld lock;
     if(context)
     {
-	auto declarations = context->findDeclarations(id, CursorInRevision(INT_MAX, INT_MAX));
-	for(Declaration* decl : declarations)
+	auto declarations = LookupCache::find(id, context);
+	for(const auto& decl : declarations)
 	{
-	    if((decl->kind() == Declaration::Import) || (decl->kind() == Declaration::Namespace) || (decl->kind() == Declaration::NamespaceAlias))
+	    if((decl.second == Declaration::Import) || (decl.second == Declaration::Namespace) || (decl.second == Declaration::NamespaceAlias))
 		continue; 
-	    return DeclarationPointer(decl);
+	    return decl.first;
 	}
     }
     return DeclarationPointer();
@@ -117,17 +222,17 @@ DeclarationPointer getTypeOrVarDeclaration(QualifiedIdentifier id, DUContext* co
 
 DeclarationPointer getTypeDeclaration(QualifiedIdentifier id, DUContext* context, bool searchInParent)
 {
-    DUChainReadLocker lock;
+    ReadLockUnlessHeld lock;
     if(context)
     {
-	auto declarations = context->findDeclarations(id, CursorInRevision(INT_MAX, INT_MAX));
-	for(Declaration* decl : declarations)
+	auto declarations = LookupCache::find(id, context);
+	for(const auto& decl : declarations)
 	{
-	    //TODO change this to just decl->kind() != Declaration::Type
-	    if((decl->kind() == Declaration::Import) || (decl->kind() == Declaration::Namespace) 
-		|| (decl->kind() == Declaration::NamespaceAlias) || (decl->kind() == Declaration::Instance))
+	    //TODO change this to just decl.second != Declaration::Type
+	    if((decl.second == Declaration::Import) || (decl.second == Declaration::Namespace) 
+		|| (decl.second == Declaration::NamespaceAlias) || (decl.second == Declaration::Instance))
 		continue; 
-	    return DeclarationPointer(decl);
+	    return decl.first;
 	}
     }
     return DeclarationPointer();
@@ -135,16 +240,16 @@ DeclarationPointer getTypeDeclaration(QualifiedIdentifier id, DUContext* context
 
 QList< Declaration* > getDeclarations(QualifiedIdentifier id, DUContext* context, bool searchInParent)
 {
-    DUChainReadLocker lock;
+    ReadLockUnlessHeld lock;
     if(context)
     {
 	QList<Declaration*> decls;
-	auto declarations = context->findDeclarations(id, CursorInRevision(INT_MAX, INT_MAX));
-	for(Declaration* decl: declarations)
+	auto declarations = LookupCache::find(id, context);
+	for(const auto& decl: declarations)
 	{
-	    if(decl->kind() == Declaration::Import)
+	    if(decl.second == Declaration::Import)
 		continue;
-	    decls << decl;
+	    decls << decl.first.data();
 	}
 	return decls;
     }
@@ -154,7 +259,7 @@ QList< Declaration* > getDeclarations(QualifiedIdentifier id, DUContext* context
 
 DeclarationPointer getFirstDeclaration(DUContext* context, bool searchInParent)
 {
-    DUChainReadLocker lock;
+    ReadLockUnlessHeld lock;
     auto declarations = context->allDeclarations(CursorInRevision::invalid(), context->topContext(), searchInParent);
     if(declarations.size()>0)
 	return DeclarationPointer(declarations.first().first);
@@ -163,7 +268,7 @@ DeclarationPointer getFirstDeclaration(DUContext* context, bool searchInParent)
 
 DeclarationPointer checkPackageDeclaration(Identifier id, TopDUContext* context)
 {
-    DUChainReadLocker lock;
+    ReadLockUnlessHeld lock;
     auto declarations = context->findLocalDeclarations(id);
     if(declarations.size() > 0)
         return DeclarationPointer(declarations.first());
@@ -20,7 +20,11 @@
 #define GOLANGHELPER_H
 
 #include <language/duchain/ducontext.h>
+#include <language/duchain/declaration.h>
+#include <QHash>
+#include <QSet>
 #include <QUrl>
+#include <QVector>
 
 #include "goduchainexport.h"
 
@@ -32,9 +36,69 @@ namespace go
 class KDEVGODUCHAIN_EXPORT Helper
 {
 public:
+    /**
+     * Returns GOPATH and GOROOT source directories from ImportEnvironment,
+     * preceded by the src directory containing @p document, if there is one.
+     **/
     static QList<QString> getSearchPaths(QUrl document=QUrl());
+};
+
+/**
+ * While it exists, lookup helpers below remember declarations they found for identifier in context,
+ * so repeated lookups of the same identifier during one build search DUChain only once.
+ * Caches are per thread, innermost one is used. DeclarationBuilder invalidates lookups which can see
+ * declarations it adds or changes, and lookups in contexts it closes, which may delete nested contexts.
+ */
+class KDEVGODUCHAIN_EXPORT LookupCache
+{
+public:
+    typedef QList<QPair<DeclarationPointer, Declaration::Kind>> Candidates;
+
+    LookupCache();
+    ~LookupCache();
+
+    /**
+     * Drops lookups done in @p context or any context nested in it from current thread's cache, if there is one.
+     * Contexts are never dereferenced, so @p context and contexts nested in it may be deleted already.
+     */
+    static void invalidate(DUContext* context);
+
+    /**
+     * Drops lookups which may find declaration @p name added or changed in @p context: lookups of @p name
+     * done in @p context or any context nested in it, and qualified lookups with @p name as member.
+     */
+    static void invalidate(DUContext* context, const Identifier& name);
+
+    /**
+     * Returns all declarations of @p id visible from @p context with their kinds.
+     * DUChain has to be locked for reading.
+     */
+    static Candidates find(const QualifiedIdentifier& id, DUContext* context);
+
+    /**
+     * Lookups answered by this cache and those which had to search DUChain.
+     */
+    int hits() const { return m_hits; }
+    int misses() const { return m_misses; }
+
 private:
-    static QList<QString> m_CachedSearchPaths;
+    typedef QPair<DUContext*, IndexedQualifiedIdentifier> Key;
+
+    struct Entry
+    {
+        Candidates candidates;
+        QualifiedIdentifier id;
+        //context of lookup and its parents, at the time of lookup
+        QVector<DUContext*> scope;
+    };
+
+    LookupCache* m_outer;
+    QHash<Key, Entry> m_entries;
+    //indexes are only added to, keys of dropped entries are skipped and pruned when an index is used
+    QHash<DUContext*, QSet<Key>> m_byScope;
+    QHash<IndexedIdentifier, QSet<Key>> m_byName;
+    int m_hits;
+    int m_misses;
 };
 
 KDEVGODUCHAIN_EXPORT DeclarationPointer getDeclaration(QualifiedIdentifier id, DUContext* context, bool searchInParent=true);
@@ -0,0 +1,197 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "importenvironment.h"
+
+#include <QDir>
+#include <QMutex>
+#include <QProcess>
+#include <QReadWriteLock>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <interfaces/icore.h>
+#include <interfaces/idocumentcontroller.h>
+#include <interfaces/ilanguagecontroller.h>
+#include <language/backgroundparser/backgroundparser.h>
+#include <language/duchain/topducontext.h>
+
+#include <atomic>
+
+#include "canonicalimportindex.h"
+#include "duchaindebug.h"
+
+namespace go
+{
+
+namespace
+{
+
+ImportEnvironment::SnapshotPointer currentSnapshot;
+//only guards copying of currentSnapshot
+QReadWriteLock snapshotLock;
+//serializes builders
+QMutex buildMutex;
+std::atomic<bool> buildStarted(false);
+
+QMutex parsedVersionsMutex;
+QHash<KDevelop::IndexedString, quint64> parsedVersions;
+
+class RefreshRunnable : public QRunnable
+{
+public:
+    virtual void run() override
+    {
+        ImportEnvironment::refresh();
+    }
+};
+
+}
+
+ImportEnvironment::SnapshotPointer ImportEnvironment::snapshot()
+{
+    {
+        QReadLocker lock(&snapshotLock);
+        if(currentSnapshot)
+            return currentSnapshot;
+    }
+    initialize();
+    //GOROOT has to be known from the start, otherwise standard library imports fail
+    static const SnapshotPointer withoutCanonicalImports = [] {
+        std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+        snapshot->version = 0;
+        snapshot->searchPaths = findSearchPaths();
+        return SnapshotPointer(snapshot);
+    }();
+    return withoutCanonicalImports;
+}
+
+void ImportEnvironment::initialize()
+{
+    if(!buildStarted.exchange(true))
+        QThreadPool::globalInstance()->start(new RefreshRunnable);
+}
+
+void ImportEnvironment::scheduleRefresh()
+{
+    buildStarted = true;
+    QThreadPool::globalInstance()->start(new RefreshRunnable);
+}
+
+void ImportEnvironment::refresh()
+{
+    buildStarted = true;
+    QMutexLocker lock(&buildMutex);
+    quint64 version;
+    {
+        QReadLocker readLock(&snapshotLock);
+        version = currentSnapshot ? currentSnapshot->version + 1 : 1;
+    }
+    SnapshotPointer snapshot = build(version);
+    {
+        QWriteLocker writeLock(&snapshotLock);
+        currentSnapshot = snapshot;
+    }
+    reparseOpenDocuments(documentsParsedBefore(version));
+}
+
+void ImportEnvironment::documentParsed(const KDevelop::IndexedString& document, quint64 version)
+{
+    QMutexLocker lock(&parsedVersionsMutex);
+    parsedVersions.insert(document, version);
+}
+
+QList<KDevelop::IndexedString> ImportEnvironment::documentsParsedBefore(quint64 version)
+{
+    QList<KDevelop::IndexedString> documents;
+    QMutexLocker lock(&parsedVersionsMutex);
+    for(auto iter = parsedVersions.constBegin(); iter != parsedVersions.constEnd(); ++iter)
+        if(iter.value() < version)
+            documents.append(iter.key());
+    return documents;
+}
+
+void ImportEnvironment::reparseOpenDocuments(const QList<KDevelop::IndexedString>& documents)
+{
+    using namespace KDevelop;
+    if(documents.isEmpty() || !ICore::self())
+        return;
+    //document controller can only be asked from main thread
+    QMetaObject::invokeMethod(ICore::self()->documentController(), [documents] {
+        IDocumentController* controller = ICore::self()->documentController();
+        BackgroundParser* parser = ICore::self()->languageController()->backgroundParser();
+        for(const IndexedString& document : documents)
+        {
+            if(controller->documentForUrl(document.toUrl()) && !parser->isQueued(document))
+                parser->addDocument(document, TopDUContext::AllDeclarationsContextsAndUses, BackgroundParser::BestPriority);
+        }
+    }, Qt::QueuedConnection);
+}
+
+ImportEnvironment::SnapshotPointer ImportEnvironment::build(quint64 version)
+{
+    std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+    snapshot->version = version;
+    snapshot->searchPaths = findSearchPaths();
+
+    CanonicalImportIndex index(CanonicalImportIndex::defaultIndexFile());
+    index.load();
+    index.update(snapshot->searchPaths);
+    if(!index.save())
+        qCDebug(DUCHAIN) << "Failed to save canonical import index";
+    snapshot->canonicalImports = index.imports();
+    return snapshot;
+}
+
+QList<QString> ImportEnvironment::findSearchPaths()
+{
+    QList<QString> searchPaths;
+    //check $GOPATH env var
+    QByteArray result = qgetenv("GOPATH");
+    if(!result.isEmpty())
+    {
+        QDir path(result);
+        if(path.exists() && path.cd("src") && path.exists())
+            searchPaths.append(path.absolutePath());
+    }
+    //then check $GOROOT
+    //these days most people don't set GOROOT manually
+    //instead go tool can find correct value for GOROOT on its own
+    //in order for this to work go exec must be in $PATH
+    QProcess p;
+    p.start("go env GOROOT");
+    p.waitForFinished();
+    result = p.readAllStandardOutput();
+    if(result.endsWith("\n"))
+        result.remove(result.length()-1, 1);
+    if(!result.isEmpty())
+    {
+        //since Go 1.4 stdlib packages are stored in $GOROOT/src/
+        //but we also support old layout $GOROOT/src/pkg/
+        QDir path = QDir(result);
+        if(path.exists() && path.cd("src") && path.exists())
+        {
+            searchPaths.append(path.absolutePath());
+            if(path.cd("pkg") && path.exists())
+                searchPaths.append(path.absolutePath());
+        }
+    }
+    return searchPaths;
+}
+
+}
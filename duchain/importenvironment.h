@@ -0,0 +1,105 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGIMPORTENVIRONMENT_H
+#define GOLANGIMPORTENVIRONMENT_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include <serialization/indexedstring.h>
+
+#include <memory>
+
+#include "goduchainexport.h"
+
+namespace go
+{
+
+/**
+ * Holds everything needed to resolve imports that doesn't depend on a particular document:
+ * GOPATH and GOROOT search paths and canonical imports found in them.
+ * It is published as an immutable snapshot, readers only share a read lock for as long as
+ * they copy the pointer, and keep their copy alive for as long as they use it.
+ * Building a snapshot walks whole GOPATH, so it is only done on a background thread,
+ * until the first one is ready readers get search paths without canonical imports.
+ * Open documents parsed against an older snapshot are reparsed once a new one is published.
+ **/
+class KDEVGODUCHAIN_EXPORT ImportEnvironment
+{
+public:
+    struct Snapshot
+    {
+        quint64 version;
+        QList<QString> searchPaths;
+        QHash<QString, QString> canonicalImports;
+    };
+    typedef std::shared_ptr<const Snapshot> SnapshotPointer;
+
+    /**
+     * Never waits for GOPATH walk. Before the first snapshot is ready, returns version 0
+     * with search paths and no canonical imports, and starts building if nobody did yet.
+     * Search paths of version 0 are found the first time it is needed, asking go tool for GOROOT.
+     **/
+    static SnapshotPointer snapshot();
+
+    /**
+     * Starts building the first snapshot on a background thread, called when plugin is loaded.
+     **/
+    static void initialize();
+
+    /**
+     * Builds a new version of search paths and canonical imports on a background thread
+     * and publishes it once it is ready. Called when projects are opened or closed.
+     **/
+    static void scheduleRefresh();
+
+    /**
+     * Looks up search paths and canonical imports again and publishes them as a new snapshot.
+     * Blocks until that is done, so don't call it from threads which can't wait for a GOPATH walk.
+     **/
+    static void refresh();
+
+    /**
+     * Remembers which snapshot @p document was parsed against.
+     **/
+    static void documentParsed(const KDevelop::IndexedString& document, quint64 version);
+
+    /**
+     * Documents which were last parsed against a snapshot older than @p version.
+     **/
+    static QList<KDevelop::IndexedString> documentsParsedBefore(quint64 version);
+
+private:
+    static SnapshotPointer build(quint64 version);
+
+    /**
+     * Asks $GOPATH and go tool for directories with package sources.
+     **/
+    static QList<QString> findSearchPaths();
+
+    /**
+     * Schedules reparse of those @p documents which are open in editor.
+     **/
+    static void reparseOpenDocuments(const QList<KDevelop::IndexedString>& documents);
+};
+
+}
+
+#endif
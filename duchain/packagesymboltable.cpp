@@ -0,0 +1,304 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "packagesymboltable.h"
+
+#include <language/duchain/duchain.h>
+#include <language/duchain/namespacealiasdeclaration.h>
+
+#include <QReadWriteLock>
+#include <QUrl>
+
+#include "parser/packagecache.h"
+
+using namespace KDevelop;
+
+namespace go
+{
+
+namespace
+{
+
+struct ImportedPackage
+{
+    IndexedString directory;
+    QString name;
+    //files of package importer has linked
+    QVector<IndexedTopDUContext> linked;
+};
+
+struct SymbolTables
+{
+    QReadWriteLock lock;
+    //packages imported by file, by package name or alias
+    QHash<IndexedString, QHash<QString, ImportedPackage>> importers;
+    //tables by package directory
+    QHash<IndexedString, PackageSymbolTable::Pointer> packages;
+    //build files by package directory, as listed by preparePackage()
+    QHash<IndexedString, QVector<IndexedString>> files;
+};
+
+Q_GLOBAL_STATIC(SymbolTables, symbolTables)
+
+IndexedString directoryOf(const IndexedString& url)
+{
+    return IndexedString(url.toUrl().adjusted(QUrl::RemoveFilename | QUrl::StripTrailingSlash));
+}
+
+QHash<QString, ImportedPackage> collectImports(TopDUContext* importer)
+{
+    QHash<QString, ImportedPackage> imports;
+    IndexedString ownDirectory = directoryOf(importer->url());
+    for(const DUContext::Import& import : importer->importedParentContexts())
+    {
+        DUContext* imported = import.context(importer);
+        if(!imported)
+            continue;
+        TopDUContext* context = imported->topContext();
+        IndexedString directory = directoryOf(context->url());
+        //other files of importer's own package
+        if(directory == ownDirectory)
+            continue;
+        auto declarations = context->localDeclarations();
+        if(declarations.isEmpty())
+            continue;
+        QString name = declarations.first()->identifier().toString();
+        ImportedPackage& package = imports[name];
+        package.directory = directory;
+        package.name = name;
+        package.linked.append(IndexedTopDUContext(context));
+    }
+    auto declarations = importer->localDeclarations();
+    if(declarations.isEmpty() || !declarations.first()->internalContext())
+        return imports;
+    for(Declaration* declaration : declarations.first()->internalContext()->localDeclarations())
+    {
+        NamespaceAliasDeclaration* alias = dynamic_cast<NamespaceAliasDeclaration*>(declaration);
+        //dot imports put declarations of package into importer's scope, those are found as usual
+        if(!alias || alias->identifier() == globalImportIdentifier())
+            continue;
+        auto package = imports.constFind(alias->importIdentifier().toString());
+        if(package != imports.constEnd())
+            imports.insert(alias->identifier().toString(), package.value());
+    }
+    return imports;
+}
+
+/**
+ * Files importer has linked may be outdated, package can have files added since it was built.
+ * So contexts are those of build files in package directory, and of files importer has linked,
+ * e.g. those not saved yet.
+ **/
+QVector<IndexedTopDUContext> packageContexts(const ImportedPackage& package)
+{
+    QVector<IndexedString> files;
+    {
+        SymbolTables* data = symbolTables;
+        QReadLocker lock(&data->lock);
+        files = data->files.value(package.directory);
+    }
+    QVector<IndexedTopDUContext> contexts;
+    auto add = [&contexts, &package](TopDUContext* context) {
+        if(!context || context->url().str().endsWith("_test.go") || contexts.contains(IndexedTopDUContext(context)))
+            return;
+        auto declarations = context->localDeclarations();
+        if(!declarations.isEmpty() && declarations.first()->identifier().toString() == package.name)
+            contexts.append(IndexedTopDUContext(context));
+    };
+    for(const IndexedString& file : files)
+    {
+        for(TopDUContext* context : DUChain::self()->chainsForDocument(file))
+            add(context);
+    }
+    for(const IndexedTopDUContext& linked : package.linked)
+        add(linked.data());
+    return contexts;
+}
+
+/**
+ * Returns true if @p name, as seen from @p context, is an import of its file and not a declaration shadowing it.
+ **/
+bool namesImport(const Identifier& name, DUContext* context)
+{
+    for(DUContext* scope = context; scope; scope = scope->parentContext())
+    {
+        QList<Declaration*> declarations = scope->findLocalDeclarations(name);
+        //parameters are declared in context of signature, which function body imports
+        for(const DUContext::Import& import : scope->importedParentContexts())
+        {
+            DUContext* imported = import.context(scope->topContext());
+            if(imported && imported->type() != DUContext::Global)
+                declarations += imported->findLocalDeclarations(name);
+        }
+        if(!declarations.isEmpty())
+            return declarations.first()->kind() == Declaration::Import || declarations.first()->kind() == Declaration::NamespaceAlias;
+    }
+    return false;
+}
+
+bool importedPackage(const Identifier& name, TopDUContext* importer, ImportedPackage* package)
+{
+    SymbolTables* data = symbolTables;
+    QString key = name.toString();
+    {
+        QReadLocker lock(&data->lock);
+        auto iter = data->importers.constFind(importer->url());
+        if(iter != data->importers.constEnd())
+        {
+            auto found = iter->constFind(key);
+            if(found == iter->constEnd())
+                return false;
+            *package = found.value();
+            return true;
+        }
+    }
+    //DUChain is read without holding our lock, so rebuilding files can't deadlock with lookups
+    QHash<QString, ImportedPackage> imports = collectImports(importer);
+    {
+        QWriteLocker lock(&data->lock);
+        data->importers.insert(importer->url(), imports);
+    }
+    auto found = imports.constFind(key);
+    if(found == imports.constEnd())
+        return false;
+    *package = found.value();
+    return true;
+}
+
+}
+
+PackageSymbolTable::Pointer PackageSymbolTable::forImport(const Identifier& packageName, TopDUContext* importer)
+{
+    ImportedPackage package;
+    if(!importer || !importedPackage(packageName, importer, &package))
+        return Pointer();
+    SymbolTables* data = symbolTables;
+    {
+        QReadLocker lock(&data->lock);
+        auto iter = data->packages.constFind(package.directory);
+        if(iter != data->packages.constEnd())
+            return iter.value();
+    }
+    Pointer table = build(packageContexts(package));
+    QWriteLocker lock(&data->lock);
+    auto iter = data->packages.constFind(package.directory);
+    if(iter != data->packages.constEnd())
+        return iter.value();
+    data->packages.insert(package.directory, table);
+    return table;
+}
+
+bool PackageSymbolTable::findImported(const QualifiedIdentifier& id, DUContext* context, QList<Declaration*>* result)
+{
+    if(id.count() < 2 || !context || !namesImport(id.first(), context))
+        return false;
+    Pointer table = forImport(id.first(), context->topContext());
+    if(!table)
+        return false;
+    *result = table->findDeclarations(id);
+    return true;
+}
+
+void PackageSymbolTable::invalidate(const IndexedString& file)
+{
+    SymbolTables* data = symbolTables;
+    QWriteLocker lock(&data->lock);
+    data->importers.remove(file);
+    data->packages.remove(directoryOf(file));
+}
+
+void PackageSymbolTable::preparePackage(const QString& directory)
+{
+    QVector<IndexedString> files;
+    for(const QString& file : PackageCache::package(directory).buildFiles)
+        files.append(IndexedString(file));
+    IndexedString key(QUrl::fromLocalFile(directory).adjusted(QUrl::StripTrailingSlash));
+    SymbolTables* data = symbolTables;
+    QWriteLocker lock(&data->lock);
+    auto iter = data->files.constFind(key);
+    if(iter != data->files.constEnd() && iter.value() == files)
+        return;
+    data->files.insert(key, files);
+    data->packages.remove(key);
+}
+
+void PackageSymbolTable::clear()
+{
+    SymbolTables* data = symbolTables;
+    QWriteLocker lock(&data->lock);
+    data->importers.clear();
+    data->packages.clear();
+    data->files.clear();
+}
+
+PackageSymbolTable::Pointer PackageSymbolTable::build(const QVector<IndexedTopDUContext>& contexts)
+{
+    std::shared_ptr<PackageSymbolTable> table(new PackageSymbolTable);
+    for(const IndexedTopDUContext& indexed : contexts)
+    {
+        TopDUContext* context = indexed.data();
+        if(!context)
+            continue;
+        for(Declaration* package : context->localDeclarations())
+        {
+            if(!package->internalContext())
+                continue;
+            for(Declaration* declaration : package->internalContext()->localDeclarations())
+            {
+                //imports of imported file are of no interest to importer
+                if(declaration->kind() == Declaration::Import || declaration->kind() == Declaration::NamespaceAlias)
+                    continue;
+                table->add(declaration);
+                //methods are declared in namespace named after receiver type
+                if(declaration->kind() == Declaration::Namespace && declaration->internalContext())
+                {
+                    for(Declaration* method : declaration->internalContext()->localDeclarations())
+                        table->add(method);
+                }
+            }
+        }
+    }
+    return table;
+}
+
+void PackageSymbolTable::add(Declaration* declaration)
+{
+    //keyed without package name, so aliases don't matter
+    m_symbols[IndexedQualifiedIdentifier(declaration->qualifiedIdentifier().mid(1))].append(IndexedDeclaration(declaration));
+}
+
+QList<Declaration*> PackageSymbolTable::findDeclarations(const QualifiedIdentifier& id) const
+{
+    QList<Declaration*> declarations;
+    auto iter = m_symbols.constFind(IndexedQualifiedIdentifier(id.mid(1)));
+    if(iter == m_symbols.constEnd())
+        return declarations;
+    for(const IndexedDeclaration& indexed : iter.value())
+    {
+        if(Declaration* declaration = indexed.declaration())
+            declarations.append(declaration);
+    }
+    return declarations;
+}
+
+int PackageSymbolTable::size() const
+{
+    return m_symbols.size();
+}
+
+}
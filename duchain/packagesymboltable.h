@@ -0,0 +1,95 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGPACKAGESYMBOLTABLE_H
+#define GOLANGPACKAGESYMBOLTABLE_H
+
+#include <language/duchain/declaration.h>
+#include <language/duchain/indexeddeclaration.h>
+#include <language/duchain/indexedtopducontext.h>
+#include <language/duchain/topducontext.h>
+
+#include <QHash>
+#include <QVector>
+
+#include <memory>
+
+#include "goduchainexport.h"
+
+namespace go
+{
+
+/**
+ * Top level declarations of all files of an imported package merged into a single hash,
+ * so looking up "fmt::Println" costs the same no matter how many files fmt has,
+ * instead of searching every file context the importer imports.
+ * Tables are kept per package directory and dropped whenever a file of that package is rebuilt,
+ * then built again from current contexts of files in that directory, not only those importer has linked.
+ * Files of a directory are listed by preparePackage() beforehand, so tables are built without touching disk.
+ * All functions, except invalidate() and preparePackage(), have to be called with DUChain read lock held.
+ **/
+class KDEVGODUCHAIN_EXPORT PackageSymbolTable
+{
+public:
+    typedef std::shared_ptr<const PackageSymbolTable> Pointer;
+
+    /**
+     * Looks @p id up in packages imported by file of @p context, if its first component names one of them,
+     * applying import aliases. Returns false if it doesn't, or if a declaration in @p context or its parents,
+     * e.g. a parameter, shadows the import. Then @p id has to be looked up as usual.
+     **/
+    static bool findImported(const KDevelop::QualifiedIdentifier& id, KDevelop::DUContext* context, QList<KDevelop::Declaration*>* result);
+
+    /**
+     * Returns table of package @p packageName imported by @p importer, or null pointer if it doesn't import one.
+     **/
+    static Pointer forImport(const KDevelop::Identifier& packageName, KDevelop::TopDUContext* importer);
+
+    /**
+     * Drops tables of package of @p file and package names imported by it. Called once @p file is rebuilt.
+     **/
+    static void invalidate(const KDevelop::IndexedString& file);
+
+    /**
+     * Lists build files of package in @p directory, dropping its table if they changed.
+     * Reads disk, so it must not be called with DUChain locked. Tables of packages nobody prepared
+     * only contain files importers have linked.
+     **/
+    static void preparePackage(const QString& directory);
+
+    static void clear();
+
+    /**
+     * Returns declarations with qualified identifier @p id, like "fmt::Println" or "http::Request::Write".
+     * First component of @p id is ignored, so it may be an alias of package as well.
+     **/
+    QList<KDevelop::Declaration*> findDeclarations(const KDevelop::QualifiedIdentifier& id) const;
+
+    int size() const;
+
+private:
+    static Pointer build(const QVector<KDevelop::IndexedTopDUContext>& contexts);
+
+    void add(KDevelop::Declaration* declaration);
+
+    QHash<KDevelop::IndexedQualifiedIdentifier, QVector<KDevelop::IndexedDeclaration>> m_symbols;
+};
+
+}
+
+#endif
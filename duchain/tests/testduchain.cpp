@@ -19,10 +19,32 @@
 #include "testduchain.h"
 
 #include "parser/parsesession.h"
+#include "parser/packagecache.h"
 #include "builders/declarationbuilder.h"
+#include "builders/usebuilder.h"
+#include "builders/builderlockscope.h"
+#include "expressionvisitor.h"
 #include "types/gointegraltype.h"
+#include "canonicalimportindex.h"
+#include "importenvironment.h"
+#include "packagesymboltable.h"
+#include "helper.h"
+#include "goparsingenvironmentfile.h"
 
 #include <QtTest/QtTest>
+#include <QTemporaryDir>
+#include <QThreadPool>
+
+#include <interfaces/icore.h>
+#include <interfaces/ilanguagecontroller.h>
+#include <language/backgroundparser/backgroundparser.h>
+#include <language/duchain/duchain.h>
+#include <language/duchain/namespacealiasdeclaration.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
 //#include <qtest_kde.h>
 
 #include <tests/testcore.h>
@@ -33,8 +55,15 @@ QTEST_MAIN(TestDuchain);
 
 using namespace KDevelop;
 
-DUContext* getPackageContext(const QString& code);
-DUContext* getMainContext(const QString& code);
+/**
+ * Builds declarations of @p code as file @p url, or as a new file if it's empty.
+ * If @p context is given, it's updated like a previous build of the file and set to the new top context.
+ * If @p session is given, it takes the session, e.g. to build uses or visit expressions with it.
+ */
+DUContext* getPackageContext(const QString& code, const IndexedString& url = IndexedString(),
+                             ReferencedTopDUContext* context = 0, std::unique_ptr<ParseSession>* session = 0);
+DUContext* getMainContext(const QString& code, const IndexedString& url = IndexedString(),
+                          ReferencedTopDUContext* context = 0, std::unique_ptr<ParseSession>* session = 0);
 
 void TestDuchain::initTestCase()
 {
@@ -571,15 +600,659 @@ void TestDuchain::test_selectCases()
     QCOMPARE(fastCast<go::GoIntegralType*>(ok->abstractType().constData())->dataType(), uint(go::GoIntegralType::TypeBool));
 }
 
-DUContext* getPackageContext(const QString& code)
+void TestDuchain::test_declarationsOnly()
+{
+    QString code("package main; type mytype int; func main() { a := mytype{1}; if a > 0 { b := func() { } } }; "
+                 "func (m mytype) method(c int) (d int) { for e := range c { } }; var last mytype");
+    ParseSession session(code.toUtf8(), 0);
+    session.setCurrentDocument(IndexedString("file:///temp/declarationsOnly"));
+    //features of import parse, see GoParseJob
+    session.setFeatures(TopDUContext::AllDeclarationsAndContexts);
+    QVERIFY(session.startParsing());
+    DeclarationBuilder builder(&session, true);
+    ReferencedTopDUContext context = builder.build(session.currentDocument(), session.ast());
+    QVERIFY(context.data());
+
+    DUChainReadLocker lock;
+    DUContext* package = context->localDeclarations().first()->internalContext();
+    QVERIFY(package);
+    QCOMPARE(package->findDeclarations(QualifiedIdentifier("last")).size(), 1);
+    auto decls = package->findDeclarations(QualifiedIdentifier("main"));
+    QCOMPARE(decls.size(), 1);
+    AbstractFunctionDeclaration* function = dynamic_cast<AbstractFunctionDeclaration*>(decls.first());
+    QVERIFY(function);
+    QVERIFY(!function->internalFunctionContext());
+    decls = package->findDeclarations(QualifiedIdentifier("mytype::method"));
+    QCOMPARE(decls.size(), 1);
+    function = dynamic_cast<AbstractFunctionDeclaration*>(decls.first());
+    QVERIFY(function);
+    QVERIFY(!function->internalFunctionContext());
+    QCOMPARE(decls.first()->abstractType()->toString(), QString("function (int) int"));
+}
+
+void TestDuchain::test_errorRecovery()
 {
+    QString code("package main\n"
+                 "type good int\n"
+                 "var broken = = 5\n"
+                 "func main() {\n"
+                 "    first := 1\n"
+                 "    second := )\n"
+                 "    third := first\n"
+                 "}\n"
+                 "func after() int { return 1 }\n");
     ParseSession session(code.toUtf8(), 0);
+    session.setCurrentDocument(IndexedString("file:///temp/errorRecovery"));
+    QVERIFY(!session.startParsing());
+    QVERIFY(session.isRecovered());
+    QList<RangeInRevision> errors = session.syntaxErrors();
+    QCOMPARE(errors.size(), 2);
+    QCOMPARE(errors[0].start, CursorInRevision(2, 0));
+    QCOMPARE(errors[1].start, CursorInRevision(5, 4));
+    DeclarationBuilder builder(&session, false);
+    ReferencedTopDUContext context = builder.build(session.currentDocument(), session.ast());
+    QVERIFY(context.data());
+
+    DUChainReadLocker lock;
+    DUContext* package = context->localDeclarations().first()->internalContext();
+    QVERIFY(package);
+    QCOMPARE(package->findDeclarations(QualifiedIdentifier("good")).size(), 1);
+    QCOMPARE(package->findDeclarations(QualifiedIdentifier("broken")).size(), 0);
+    QCOMPARE(package->findDeclarations(QualifiedIdentifier("after")).size(), 1);
+    QCOMPARE(package->findDeclarations(QualifiedIdentifier("main")).size(), 1);
+    DUContext* body = context->findContextAt(CursorInRevision(6, 4));
+    QVERIFY(body);
+    QCOMPARE(body->findDeclarations(QualifiedIdentifier("first")).size(), 1);
+    QCOMPARE(body->findDeclarations(QualifiedIdentifier("third")).size(), 1);
+
+    //broken if header must not keep parser in if clause mode, where composite literals are rejected
+    QString brokenIf("package main\n"
+                     "type point struct { x int }\n"
+                     "func broken() {\n"
+                     "    if a := ; {\n"
+                     "    }\n"
+                     "}\n"
+                     "func after() point { return point{1} }\n"
+                     "var last = point{2}\n");
+    lock.unlock();
+    ParseSession brokenIfSession(brokenIf.toUtf8(), 0);
+    brokenIfSession.setCurrentDocument(IndexedString("file:///temp/errorRecoveryIf"));
+    QVERIFY(!brokenIfSession.startParsing());
+    QVERIFY(brokenIfSession.isRecovered());
+    for(const RangeInRevision& error : brokenIfSession.syntaxErrors())
+        QVERIFY(error.start.line < 6);
+    DeclarationBuilder brokenIfBuilder(&brokenIfSession, false);
+    ReferencedTopDUContext brokenIfContext = brokenIfBuilder.build(brokenIfSession.currentDocument(), brokenIfSession.ast());
+    QVERIFY(brokenIfContext.data());
+    lock.lock();
+    package = brokenIfContext->localDeclarations().first()->internalContext();
+    QCOMPARE(package->findDeclarations(QualifiedIdentifier("after")).size(), 1);
+    QCOMPARE(package->findDeclarations(QualifiedIdentifier("last")).size(), 1);
+}
+
+void TestDuchain::test_incrementalReparse()
+{
+    IndexedString document("file:///temp/incrementalReparse");
+    QByteArray first("package main\nfunc unchanged() {\n    kept := 1\n}\nfunc edited() {\n    old := 2\n}\n"
+                     "func after() {\n    shifted := 3\n}\n");
+    //edit keeps line count, so contexts after it don't need to be moved
+    QByteArray second(first);
+    second.replace("old := 2", "newer := 22");
+    auto reusedBodies = [](ParseSession& session) {
+        QStringList reused;
+        auto iter = session.ast()->sourceFile->topDeclarationsSequence->front(), end = iter;
+        do
+        {
+            go::FuncDeclarationAst* function = iter->element->funcDecl;
+            go::MethodDeclarationAst* method = iter->element->methodDecl;
+            if(function && session.isBodyReused(function))
+                reused.append(session.symbol(function->funcName->id));
+            if(method && session.isBodyReused(method))
+                reused.append(session.symbol(method->methodName->id));
+            iter = iter->next;
+        }
+        while(iter != end);
+        return reused;
+    };
+
+    ReferencedTopDUContext context;
+    {
+        ParseSession session(first, 0);
+        session.setCurrentDocument(document);
+        session.setIncrementalParsing(true);
+        QVERIFY(session.startParsing());
+        QVERIFY(reusedBodies(session).isEmpty());
+        DeclarationBuilder builder(&session, false);
+        context = builder.build(document, session.ast());
+        QVERIFY(context.data());
+        session.rememberFunctionBodies();
+    }
+    {
+        ParseSession session(second, 0);
+        session.setCurrentDocument(document);
+        session.setIncrementalParsing(true);
+        QVERIFY(session.startParsing());
+        QCOMPARE(reusedBodies(session), QStringList() << "unchanged" << "after");
+        DeclarationBuilder builder(&session, false);
+        context = builder.build(document, session.ast(), context);
+        QVERIFY(context.data());
+        session.rememberFunctionBodies();
+
+        DUChainReadLocker lock;
+        QCOMPARE(context->findContextAt(CursorInRevision(2, 4))->findDeclarations(QualifiedIdentifier("kept")).size(), 1);
+        QCOMPARE(context->findContextAt(CursorInRevision(5, 4))->findDeclarations(QualifiedIdentifier("newer")).size(), 1);
+        QCOMPARE(context->findContextAt(CursorInRevision(5, 4))->findDeclarations(QualifiedIdentifier("old")).size(), 0);
+        QCOMPARE(context->findContextAt(CursorInRevision(8, 4))->findDeclarations(QualifiedIdentifier("shifted")).size(), 1);
+    }
+    {
+        //inserted line moves every body below it, kept contexts have to follow
+        QByteArray third(second);
+        third.replace("package main\n", "package main\n// inserted line\n");
+        DUContext* afterBody;
+        {
+            DUChainReadLocker lock;
+            afterBody = context->findContextAt(CursorInRevision(8, 4));
+        }
+        ParseSession session(third, 0);
+        session.setCurrentDocument(document);
+        session.setIncrementalParsing(true);
+        QVERIFY(session.startParsing());
+        QCOMPARE(reusedBodies(session), QStringList() << "unchanged" << "edited" << "after");
+        DeclarationBuilder builder(&session, false);
+        context = builder.build(document, session.ast(), context);
+        QVERIFY(context.data());
+        session.rememberFunctionBodies();
+
+        DUChainReadLocker lock;
+        QCOMPARE(context->findContextAt(CursorInRevision(9, 4)), afterBody);
+        QList<Declaration*> shifted = afterBody->findDeclarations(QualifiedIdentifier("shifted"));
+        QCOMPARE(shifted.size(), 1);
+        QCOMPARE(shifted.first()->range().start, CursorInRevision(9, 4));
+        QCOMPARE(context->findContextAt(CursorInRevision(3, 4))->findDeclarations(QualifiedIdentifier("kept")).size(), 1);
+        QCOMPARE(context->findContextAt(CursorInRevision(6, 4))->findDeclarations(QualifiedIdentifier("newer")).size(), 1);
+    }
+    {
+        //fresh DUChain has no contexts to reuse, so skipped bodies get parsed while building
+        ParseSession session(second, 0);
+        session.setCurrentDocument(document);
+        session.setIncrementalParsing(true);
+        QVERIFY(session.startParsing());
+        QCOMPARE(reusedBodies(session).size(), 3);
+        DeclarationBuilder builder(&session, false);
+        ReferencedTopDUContext fresh = builder.build(document, session.ast());
+        QVERIFY(fresh.data());
+
+        DUChainReadLocker lock;
+        QCOMPARE(fresh->findContextAt(CursorInRevision(2, 4))->findDeclarations(QualifiedIdentifier("kept")).size(), 1);
+        QCOMPARE(fresh->findContextAt(CursorInRevision(8, 4))->findDeclarations(QualifiedIdentifier("shifted")).size(), 1);
+    }
+
+    //receiver and parameters belong to declaration, so edited signatures rebuild bodies using them
+    IndexedString signatures("file:///temp/incrementalSignatures");
+    QByteArray base("package main\ntype T struct { value int }\ntype U struct { value string }\n"
+                    "func (t T) method() {\n    x := t.value\n}\nfunc other(b int) {\n    y := b\n}\n");
+    QByteArray receiverEdited(base);
+    receiverEdited.replace("(t T)", "(t U)");
+    QByteArray parameterEdited(receiverEdited);
+    parameterEdited.replace("(b int)", "(b string)");
+    ReferencedTopDUContext signatureContext;
+    for(const QByteArray& contents : {base, receiverEdited, parameterEdited})
+    {
+        ParseSession session(contents, 0);
+        session.setCurrentDocument(signatures);
+        session.setIncrementalParsing(true);
+        QVERIFY(session.startParsing());
+        QVERIFY(reusedBodies(session).isEmpty());
+        DeclarationBuilder builder(&session, false);
+        signatureContext = builder.build(signatures, session.ast(), signatureContext);
+        QVERIFY(signatureContext.data());
+        session.rememberFunctionBodies();
+    }
+    DUChainReadLocker lock;
+    QList<Declaration*> x = signatureContext->findContextAt(CursorInRevision(4, 4))->findDeclarations(QualifiedIdentifier("x"));
+    QCOMPARE(x.size(), 1);
+    QCOMPARE(x.first()->abstractType()->toString(), QString("string"));
+    QList<Declaration*> y = signatureContext->findContextAt(CursorInRevision(7, 4))->findDeclarations(QualifiedIdentifier("y"));
+    QCOMPARE(y.size(), 1);
+    QCOMPARE(y.first()->abstractType()->toString(), QString("string"));
+}
+
+void TestDuchain::test_canonicalImportIndex()
+{
+    QTemporaryDir searchPath;
+    QVERIFY(searchPath.isValid());
+    auto writeFile = [&searchPath](const QString& name, const QByteArray& contents) {
+        QFileInfo info(searchPath.path() + "/" + name);
+        QDir().mkpath(info.absolutePath());
+        QFile file(info.absoluteFilePath());
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+    };
+    writeFile("canonical/a.go", "// Copyright notice\n/* multiline\n comment */\npackage canonical // import \"example.org/canonical\"\n");
+    writeFile("nested/deeper/b.go", "package deeper /* import \"example.org/deeper\" */\n\nfunc f() {}\n");
+    writeFile("plain/c.go", "package plain\n// import \"example.org/wrong\"\n");
+
+    QString indexFile = searchPath.path() + "/index";
+    go::CanonicalImportIndex index(indexFile);
+    QVERIFY(!index.load());
+    index.update(QStringList(searchPath.path()));
+    QHash<QString, QString> imports = index.imports();
+    QCOMPARE(imports.size(), 2);
+    QCOMPARE(imports["example.org/canonical"], searchPath.path() + "/canonical");
+    QCOMPARE(imports["example.org/deeper"], searchPath.path() + "/nested/deeper");
+    QVERIFY(index.save());
+
+    go::CanonicalImportIndex loaded(indexFile);
+    QVERIFY(loaded.load());
+    QCOMPARE(loaded.imports(), imports);
+
+    //removed packages are forgotten on update
+    QVERIFY(QDir(searchPath.path() + "/canonical").removeRecursively());
+    loaded.update(QStringList(searchPath.path()));
+    QCOMPARE(loaded.imports().keys(), QList<QString>() << "example.org/deeper");
+
+    //file edited in place is read again, even though its directory didn't change
+    writeFile("nested/deeper/b.go", "package deeper /* import \"example.org/moved/deeper\" */\n\nfunc f() {}\n");
+    loaded.update(QStringList(searchPath.path()));
+    QCOMPARE(loaded.imports().keys(), QList<QString>() << "example.org/moved/deeper");
+}
+
+void TestDuchain::test_importEnvironment()
+{
+    //snapshot() never waits for GOPATH walk, until one is built it only lacks canonical imports
+    go::ImportEnvironment::SnapshotPointer bootstrap = go::ImportEnvironment::snapshot();
+    QVERIFY(bootstrap);
+    if(bootstrap->version == 0)
+        QVERIFY(bootstrap->canonicalImports.isEmpty());
+    IndexedString document("file:///temp/importEnvironment.go");
+    go::ImportEnvironment::documentParsed(document, bootstrap->version);
+    //wait for background build started by snapshot(), then publish one ourselves
+    QThreadPool::globalInstance()->waitForDone();
+    go::ImportEnvironment::refresh();
+    go::ImportEnvironment::SnapshotPointer first = go::ImportEnvironment::snapshot();
+    QVERIFY(first->version > 0);
+    QCOMPARE(first->searchPaths, bootstrap->searchPaths);
+    //document parsed against the bootstrap snapshot is due for reparse, until it is parsed again
+    QVERIFY(go::ImportEnvironment::documentsParsedBefore(first->version).contains(document));
+    go::ImportEnvironment::documentParsed(document, first->version);
+    QVERIFY(!go::ImportEnvironment::documentsParsedBefore(first->version).contains(document));
+    //all readers share the published snapshot
+    std::vector<go::ImportEnvironment::SnapshotPointer> seen(4);
+    std::vector<std::thread> readers;
+    for(size_t i = 0; i < seen.size(); ++i)
+        readers.emplace_back([&seen, i]() { seen[i] = go::ImportEnvironment::snapshot(); });
+    for(std::thread& reader : readers)
+        reader.join();
+    for(const go::ImportEnvironment::SnapshotPointer& snapshot : seen)
+        QCOMPARE(snapshot.get(), first.get());
+
+    go::ImportEnvironment::refresh();
+    go::ImportEnvironment::SnapshotPointer second = go::ImportEnvironment::snapshot();
+    QVERIFY(second.get() != first.get());
+    QCOMPARE(second->version, first->version + 1);
+    QCOMPARE(second->searchPaths, first->searchPaths);
+    QCOMPARE(second->canonicalImports, first->canonicalImports);
+}
+
+void TestDuchain::test_packageContexts()
+{
+    //how GoParseJob builds all files of an imported package together
+    QList<QByteArray> code{"package pkg; type Item struct { next *Item }",
+                           "package pkg; var first Item; func Last() *Item { return nil }"};
+    std::vector<std::unique_ptr<ParseSession>> sessions;
+    std::vector<std::unique_ptr<DeclarationBuilder>> builders;
+    QList<ReferencedTopDUContext> contexts;
+    for(int i = 0; i < code.size(); ++i)
+    {
+        sessions.emplace_back(new ParseSession(code[i], 0));
+        sessions.back()->setCurrentDocument(IndexedString(QString("file:///temp/package/%1.go").arg(i)));
+        sessions.back()->setFeatures(TopDUContext::AllDeclarationsAndContexts);
+        QVERIFY(sessions.back()->startParsing());
+        builders.emplace_back(new DeclarationBuilder(sessions.back().get(), true));
+        builders.back()->setPackageContexts(QList<ReferencedTopDUContext>());
+        contexts.append(builders.back()->forwardDeclare(sessions.back()->currentDocument(), sessions.back()->ast()));
+        QVERIFY(contexts.last().data());
+    }
+    {
+        DUChainReadLocker lock;
+        QVERIFY(contexts[1]->importedParentContexts().isEmpty());
+    }
+    //every file is built once against the same package scope, in any order
+    for(int i = code.size() - 1; i >= 0; --i)
+    {
+        builders[i]->setPackageContexts(contexts);
+        contexts[i] = builders[i]->build(sessions[i]->currentDocument(), sessions[i]->ast(), contexts[i]);
+    }
+
+    DUChainReadLocker lock;
+    QCOMPARE(contexts[1]->importedParentContexts().size(), 1);
+    QCOMPARE(contexts[0]->importedParentContexts().size(), 1);
+    DUContext* package = contexts[1]->localDeclarations().first()->internalContext();
+    auto decls = package->findDeclarations(QualifiedIdentifier("first"));
+    QCOMPARE(decls.size(), 1);
+    QCOMPARE(decls.first()->abstractType()->toString(), QString("pkg::Item"));
+}
+
+void TestDuchain::test_packageSymbolTable()
+{
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+    QString libDirectory = root.path() + "/symbols/lib";
+    QVERIFY(QDir().mkpath(libDirectory));
+    auto writeFile = [](const QString& path, const QString& contents) {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents.toUtf8());
+    };
+    QStringList code{"package lib; type Item struct {}; func (i Item) Name() string { return \"\" }",
+                     "package lib; func NewItem() Item { return Item{} }",
+                     "package main; import alias \"lib\"; func main() {}; func shadow(alias int) { alias++ }"};
+    QStringList urls{QUrl::fromLocalFile(libDirectory + "/a.go").toString(), QUrl::fromLocalFile(libDirectory + "/b.go").toString(),
+                     "file:///temp/symbols/main/main.go"};
+    writeFile(libDirectory + "/a.go", code[0]);
+    writeFile(libDirectory + "/b.go", code[1]);
+    QList<ReferencedTopDUContext> contexts;
+    for(int i = 0; i < code.size(); ++i)
+    {
+        //"lib" is not in search paths, so importer doesn't find it on its own
+        ReferencedTopDUContext context;
+        QVERIFY(getPackageContext(code[i], IndexedString(urls[i]), &context));
+        contexts.append(context);
+    }
+    DUContext* package;
+    {
+        //link import of "lib" as visitImportSpec would
+        DUChainWriteLocker lock;
+        contexts[2]->addImportedParentContext(contexts[0].data());
+        contexts[2]->addImportedParentContext(contexts[1].data());
+        package = contexts[2]->localDeclarations().first()->internalContext();
+        NamespaceAliasDeclaration* alias = new NamespaceAliasDeclaration(RangeInRevision(), package);
+        alias->setIdentifier(Identifier("alias"));
+        alias->setImportIdentifier(QualifiedIdentifier("lib"));
+        alias->setKind(Declaration::NamespaceAlias);
+    }
+    go::PackageSymbolTable::invalidate(IndexedString(urls[2]));
+
+    DUChainReadLocker lock;
+    TopDUContext* importer = contexts[2].data();
+    go::PackageSymbolTable::Pointer table = go::PackageSymbolTable::forImport(Identifier("lib"), importer);
+    QVERIFY(table);
+    QCOMPARE(table->size(), 3);
+    QCOMPARE(go::PackageSymbolTable::forImport(Identifier("alias"), importer).get(), table.get());
+    QList<Declaration*> declarations;
+    QVERIFY(go::PackageSymbolTable::findImported(QualifiedIdentifier("alias::NewItem"), package, &declarations));
+    QCOMPARE(declarations.size(), 1);
+    QVERIFY(go::PackageSymbolTable::findImported(QualifiedIdentifier("alias::Item::Name"), package, &declarations));
+    QCOMPARE(declarations.size(), 1);
+    QCOMPARE(declarations.first()->identifier().toString(), QString("Name"));
+    //package is known, so missing symbol doesn't fall back to searching imported contexts
+    QVERIFY(go::PackageSymbolTable::findImported(QualifiedIdentifier("alias::Missing"), package, &declarations));
+    QVERIFY(declarations.isEmpty());
+    QVERIFY(!go::PackageSymbolTable::findImported(QualifiedIdentifier("other::Item"), package, &declarations));
+    QVERIFY(!go::PackageSymbolTable::findImported(QualifiedIdentifier("alias"), package, &declarations));
+    //only alias of the import is declared in importer, so package name is looked up as usual
+    QVERIFY(!go::PackageSymbolTable::findImported(QualifiedIdentifier("lib::NewItem"), package, &declarations));
+    QCOMPARE(go::getDeclaration(QualifiedIdentifier("lib::Item"), importer)->identifier().toString(), QString("Item"));
+    //parameter named like the alias shadows it
+    DUContext* body = importer->findContextAt(CursorInRevision(0, code[2].indexOf("alias++")));
+    QVERIFY(body && body != package);
+    QVERIFY(!go::PackageSymbolTable::findImported(QualifiedIdentifier("alias::NewItem"), body, &declarations));
+    //rebuilding a file of package drops its table
+    go::PackageSymbolTable::invalidate(IndexedString(urls[1]));
+    QVERIFY(go::PackageSymbolTable::forImport(Identifier("lib"), importer).get() != table.get());
+
+    //file added to package is found before importer links it, once package is listed again
+    lock.unlock();
+    writeFile(libDirectory + "/c.go", "package lib; func Added() {}");
+    IndexedString added(QUrl::fromLocalFile(libDirectory + "/c.go"));
+    ReferencedTopDUContext addedContext;
+    QVERIFY(getPackageContext("package lib; func Added() {}", added, &addedContext));
+    go::PackageCache::clear();
+    go::PackageSymbolTable::preparePackage(libDirectory);
+    lock.lock();
+    QVERIFY(!importer->imports(addedContext.data()));
+    QVERIFY(go::PackageSymbolTable::findImported(QualifiedIdentifier("alias::Added"), package, &declarations));
+    QCOMPARE(declarations.size(), 1);
+    QCOMPARE(go::PackageSymbolTable::forImport(Identifier("lib"), importer)->size(), 4);
+}
+
+void TestDuchain::test_exportFingerprint()
+{
+    auto fingerprint = [](const QString& code) -> quint64 {
+        ReferencedTopDUContext context;
+        if(!getPackageContext(code, IndexedString(), &context))
+            return 0;
+        DUChainReadLocker lock;
+        //builder sets up environment able to keep fingerprint
+        if(!context || !dynamic_cast<go::GoParsingEnvironmentFile*>(context->parsingEnvironmentFile().data()))
+            return 0;
+        return go::GoParsingEnvironmentFile::fingerprintExports(context.data());
+    };
+    quint64 original = fingerprint("package lib; type Item struct { Name string }; func (i Item) Get() int { return 1 }; "
+                                "func helper() {}; func Run(a int) string { b := a; return \"\" }");
+    QVERIFY(original != 0);
+    //bodies, unexported declarations and order don't matter
+    QCOMPARE(fingerprint("package lib; func helper(x int) {}; func Run(a int) string { c := a + 1; return \"x\" }; "
+                         "type Item struct { Name string }; func (i Item) Get() int { return 2 }"), original);
+    QVERIFY(fingerprint("package lib; type Item struct { Name string }; func (i Item) Get() int { return 1 }; "
+                        "func helper() {}; func Run(a int) int { return 1 }") != original);
+    QVERIFY(fingerprint("package lib; type Item struct { Name int }; func (i Item) Get() int { return 1 }; "
+                        "func helper() {}; func Run(a int) string { return \"\" }") != original);
+    QVERIFY(fingerprint("package lib; type Item struct { Name string }; func (i Item) Get() string { return \"\" }; "
+                        "func helper() {}; func Run(a int) string { return \"\" }") != original);
+    QVERIFY(fingerprint("package other; type Item struct { Name string }; func (i Item) Get() int { return 1 }; "
+                        "func helper() {}; func Run(a int) string { return \"\" }") != original);
+
+    //only the edited document schedules its importers, rebuilt importers don't pass it on
+    IndexedString library("file:///temp/fingerprint/importers/lib.go"), user("file:///temp/fingerprint/importers/user.go");
+    std::unique_ptr<ParseSession> librarySession;
+    ReferencedTopDUContext libraryContext;
+    QVERIFY(getPackageContext("package lib; func Run() {}", library, &libraryContext, &librarySession));
+    ReferencedTopDUContext userContext;
+    {
+        DUChainWriteLocker lock;
+        userContext = new TopDUContext(user, RangeInRevision(0, 0, INT_MAX, INT_MAX));
+        DUChain::self()->addDocumentChain(userContext);
+        userContext->addImportedParentContext(libraryContext.data());
+    }
+    BackgroundParser* backgroundParser = ICore::self()->languageController()->backgroundParser();
+    ParseSession importerSession("package lib; func Run() {}", BackgroundParser::WorstPriority);
+    importerSession.setCurrentDocument(library);
+    importerSession.reparseImporters(libraryContext.data());
+    QVERIFY(!backgroundParser->isQueued(user));
+    librarySession->reparseImporters(libraryContext.data());
+    QVERIFY(backgroundParser->isQueued(user));
+    backgroundParser->removeDocument(user);
+}
+
+void TestDuchain::test_forwardDeclarations()
+{
+    IndexedString document("file:///temp/forwardDeclarations");
+    QString code("package main\nfunc main() {\n    a := later()\n    b := value\n    c := a.method()\n}\n"
+                 "// later returns mytype\nfunc later() mytype { return mytype(1) }\n"
+                 "func (m mytype) method() string { return \"\" }\ntype mytype int\nvar value = later()\n");
+    ReferencedTopDUContext context;
+    DUContext* body = 0;
+    for(int build = 0; build < 2; ++build)
+    {
+        DUContext* package = getPackageContext(code, document, &context);
+        QVERIFY(package);
+
+        DUChainReadLocker lock;
+        DUContext* main = context->findContextAt(CursorInRevision(2, 4));
+        QVERIFY(main);
+        //body context is kept by forward declaration pass
+        if(body)
+            QCOMPARE(main, body);
+        body = main;
+        QCOMPARE(main->findDeclarations(QualifiedIdentifier("a")).first()->abstractType()->toString(), QString("main::mytype"));
+        QCOMPARE(main->findDeclarations(QualifiedIdentifier("b")).first()->abstractType()->toString(), QString("main::mytype"));
+        QCOMPARE(main->findDeclarations(QualifiedIdentifier("c")).first()->abstractType()->toString(), QString("string"));
+        //comments are only read by the real pass
+        QVERIFY(package->findDeclarations(QualifiedIdentifier("later")).first()->comment().contains("later returns mytype"));
+    }
+}
+
+void TestDuchain::test_mappedUses()
+{
+    QString code("package main\nfunc foo() int { return 1 }\nfunc bar(x int) {}\n"
+                 "func main() {\n    a := foo()\n    bar(a)\n    b := foo() + a\n}\n");
+    std::unique_ptr<ParseSession> session;
+    DUContext* package = getPackageContext(code, IndexedString("file:///temp/mappedUses"), 0, &session);
+    QVERIFY(package);
+    //initializers are resolved while declaring variables, call statement only by use builder
+    go::UseBuilder useBuilder(session.get());
+    useBuilder.buildUses(session->ast());
+    QVERIFY(useBuilder.mappedExpressions() > 0);
+    QVERIFY(useBuilder.resolvedExpressions() > 0);
+
+    DUChainReadLocker lock;
+    auto useCount = [&](DUContext* ctx, const QString& name) {
+        Declaration* decl = ctx->findDeclarations(QualifiedIdentifier(name)).first();
+        return decl->uses().value(session->currentDocument()).size();
+    };
+    QCOMPARE(useCount(package, "foo"), 2);
+    QCOMPARE(useCount(package, "bar"), 1);
+}
+
+void TestDuchain::test_expressionMemo()
+{
+    QString code("package main; type chain struct { value int }; func (c chain) next() chain { return c }; "
+                 "func f(a chain) chain { return a }; var x = f(f(f(chain{1}))).next().next().value");
+    std::unique_ptr<ParseSession> session;
+    DUContext* package = getPackageContext(code, IndexedString("file:///temp/expressionMemo"), 0, &session);
+    QVERIFY(package);
+    go::ExpressionAst* expression = session->ast()->sourceFile->topDeclarationsSequence->back()->element->declaration->varDecl->varSpec->expression;
+    go::PrimaryExprAst* primary = expression->unaryExpression->primaryExpr;
+
+    go::ExpressionVisitor first(session.get(), package);
+    first.visitExpression(expression);
+    MemoizedExpression memo;
+    QVERIFY(session->memoizedExpression(primary, package, &memo));
+    QCOMPARE(memo.uses.size(), first.allIds().size());
+    //second evaluation is served from memo and gives the same result
+    int hits = session->memoizedExpressionHits();
+    go::ExpressionVisitor second(session.get(), package);
+    second.visitExpression(expression);
+    QCOMPARE(session->memoizedExpressionHits(), hits + 1);
+    QCOMPARE(second.allIds(), first.allIds());
+    QCOMPARE(second.allDeclarations(), first.allDeclarations());
+    DUChainReadLocker lock;
+    QCOMPARE(first.lastTypes().first()->toString(), QString("int"));
+    QCOMPARE(second.lastTypes().first()->toString(), QString("int"));
+}
+
+void TestDuchain::test_lookupCache()
+{
+    IndexedString document("file:///temp/lookupCache");
+    go::LookupCache cache;
+    ReferencedTopDUContext context;
+    DUContext* package = getPackageContext("package main; var x int", document, &context);
+    QVERIFY(package);
+    DeclarationPointer x = go::getTypeOrVarDeclaration(QualifiedIdentifier("x"), package);
+    QVERIFY(x);
+    QCOMPARE(go::getDeclaration(QualifiedIdentifier("x"), package), x);
+    QVERIFY(!go::getTypeDeclaration(QualifiedIdentifier("x"), package));
+    QVERIFY(!go::getDeclaration(QualifiedIdentifier("y"), package));
+
+    //rebuilding drops cached lookups, both for new and changed declarations
+    QCOMPARE(getPackageContext("package main; type x int; var y x", document, &context), package);
+    QVERIFY(go::getTypeDeclaration(QualifiedIdentifier("x"), package));
+    QVERIFY(go::getDeclaration(QualifiedIdentifier("y"), package));
+
+    //only lookups which can see a new declaration are dropped
+    int misses = cache.misses();
+    go::LookupCache::invalidate(package, Identifier("z"));
+    QVERIFY(go::getDeclaration(QualifiedIdentifier("y"), package));
+    QCOMPARE(cache.misses(), misses);
+    go::LookupCache::invalidate(package, Identifier("y"));
+    QVERIFY(go::getDeclaration(QualifiedIdentifier("y"), package));
+    QCOMPARE(cache.misses(), misses + 1);
+
+    //repeated lookups during a build are answered by cache
+    go::LookupCache buildCache;
+    QCOMPARE(getPackageContext("package main; type T int; func f(a T, b T) T { var c T = a; return c + b }", document, &context), package);
+    QVERIFY(buildCache.hits() > 0);
+    DUChainReadLocker lock;
+    QCOMPARE(package->findDeclarations(QualifiedIdentifier("f")).size(), 1);
+    go::GoFunctionType::Ptr function = package->findDeclarations(QualifiedIdentifier("f")).first()->abstractType().cast<go::GoFunctionType>();
+    QVERIFY(function);
+    QCOMPARE(function->arguments().size(), 2);
+    QCOMPARE(function->arguments().first()->toString(), QString("main::T"));
+}
+
+void TestDuchain::test_builderLockScope()
+{
+    go::BuilderLockScope::resetStatistics();
+    {
+        go::BuilderLockScope outer;
+        QVERIFY(DUChain::lock()->currentThreadHasWriteLock());
+        {
+            go::BuilderLockScope inner;
+        }
+        QVERIFY(DUChain::lock()->currentThreadHasWriteLock());
+    }
+    QVERIFY(!DUChain::lock()->currentThreadHasWriteLock());
+    go::BuilderLockScope::Statistics statistics = go::BuilderLockScope::statistics();
+    QCOMPARE(statistics.acquisitions, quint64(1));
+    QCOMPARE(statistics.nested, quint64(1));
+
+    //counters of a thread are not affected by scopes of other threads
+    go::BuilderLockScope::Statistics start = go::BuilderLockScope::threadStatistics();
+    std::thread other([]() { go::BuilderLockScope scope; });
+    other.join();
+    QCOMPARE(go::BuilderLockScope::threadStatistics().since(start).acquisitions, quint64(0));
+    {
+        go::BuilderLockScope scope;
+    }
+    QCOMPARE(go::BuilderLockScope::threadStatistics().since(start).acquisitions, quint64(1));
+    QCOMPARE(go::BuilderLockScope::statistics().acquisitions, quint64(3));
+
+    //scope which has to wait for another thread holding DUChain is counted as contended
+    go::BuilderLockScope::resetStatistics();
+    std::atomic<bool> held(false);
+    std::thread holder([&held]() {
+        DUChainWriteLocker lock;
+        held = true;
+        QThread::msleep(50);
+    });
+    while(!held)
+        QThread::yieldCurrentThread();
+    {
+        go::BuilderLockScope scope;
+        QVERIFY(DUChain::lock()->currentThreadHasWriteLock());
+    }
+    holder.join();
+    statistics = go::BuilderLockScope::statistics();
+    QCOMPARE(statistics.acquisitions, quint64(1));
+    QCOMPARE(statistics.contended, quint64(1));
+    QVERIFY(statistics.waitedNanoseconds > 0);
+
+    //builders lock once per top level declaration, helpers inside don't lock again
+    go::BuilderLockScope::resetStatistics();
+    DUContext* context = getMainContext("package main; type mytype int; func helper() mytype { return 1 }; "
+                                        "func main() { a := helper(); b := mytype(2) }");
+    QVERIFY(context);
+    statistics = go::BuilderLockScope::statistics();
+    QVERIFY(statistics.acquisitions >= 3);
+    QVERIFY(!DUChain::lock()->currentThreadHasWriteLock());
+    DUChainReadLocker lock;
+    QCOMPARE(context->findDeclarations(QualifiedIdentifier("a")).first()->abstractType()->toString(), QString("main::mytype"));
+}
+
+DUContext* getPackageContext(const QString& code, const IndexedString& url, ReferencedTopDUContext* previous, std::unique_ptr<ParseSession>* keepSession)
+{
     static int testNumber = 0;
-    session.setCurrentDocument(IndexedString(QString("file:///temp/%1").arg(testNumber++)));
-    if(!session.startParsing())
+    std::unique_ptr<ParseSession> session(new ParseSession(code.toUtf8(), 0));
+    session->setCurrentDocument(url.isEmpty() ? IndexedString(QString("file:///temp/%1").arg(testNumber++)) : url);
+    if(!session->startParsing())
 	return 0;
-    DeclarationBuilder builder(&session, false);
-    ReferencedTopDUContext context =  builder.build(session.currentDocument(), session.ast());
+    DeclarationBuilder builder(session.get(), false);
+    ReferencedTopDUContext context = builder.build(session->currentDocument(), session->ast(), previous ? *previous : ReferencedTopDUContext());
+    if(previous)
+        *previous = context;
+    if(keepSession)
+        *keepSession = std::move(session);
     if(!context)
 	return 0;
 
@@ -592,9 +1265,9 @@ DUContext* getPackageContext(const QString& code)
     return packageContext;
 }
 
-DUContext* getMainContext(const QString& code)
+DUContext* getMainContext(const QString& code, const IndexedString& url, ReferencedTopDUContext* context, std::unique_ptr<ParseSession>* session)
 {
-    DUContext* package = getPackageContext(code);
+    DUContext* package = getPackageContext(code, url, context, session);
     if(!package)
 	return 0;
     DUChainReadLocker lock;
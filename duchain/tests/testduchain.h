@@ -48,6 +48,19 @@ private slots:
     void test_unaryOps();
     void test_typeAssertions();
     void test_selectCases();
+    void test_declarationsOnly();
+    void test_errorRecovery();
+    void test_incrementalReparse();
+    void test_canonicalImportIndex();
+    void test_importEnvironment();
+    void test_packageContexts();
+    void test_packageSymbolTable();
+    void test_exportFingerprint();
+    void test_forwardDeclarations();
+    void test_mappedUses();
+    void test_expressionMemo();
+    void test_lookupCache();
+    void test_builderLockScope();
 };
 
 
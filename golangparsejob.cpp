@@ -25,20 +25,114 @@
 #include <language/duchain/duchain.h>
 #include <language/duchain/parsingenvironment.h>
 #include <language/duchain/problem.h>
+#include <interfaces/foregroundlock.h>
+#include <interfaces/icore.h>
+#include <interfaces/idocument.h>
+#include <interfaces/idocumentcontroller.h>
 
+#include <KLocalizedString>
+#include <KTextEditor/Document>
+
+#include <QFile>
+#include <QMutex>
 #include <QReadLocker>
 #include <QProcess>
-#include <QDirIterator>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 #include "parsesession.h"
+#include "modulegraph.h"
+#include "preamble.h"
+#include "packagecache.h"
 #include "duchain/builders/declarationbuilder.h"
 #include "duchain/builders/usebuilder.h"
+#include "duchain/builders/builderlockscope.h"
 #include "duchain/helper.h"
+#include "duchain/importenvironment.h"
+#include "duchain/packagesymboltable.h"
+#include "duchain/goparsingenvironmentfile.h"
 #include "godebug.h"
 
 using namespace KDevelop;
 
-QHash<QString, QString> GoParseJob::canonicalImports;
+namespace
+{
+
+/**
+ * Reads @p files, taking contents of those opened in editor from their documents, as they may be not saved yet.
+ */
+QList<QByteArray> readFiles(const QStringList& files)
+{
+    QList<QByteArray> contents;
+    QList<int> unopened;
+    {
+        //documents can only be read from main thread, this waits for it once for all files
+        ForegroundLock lock;
+        IDocumentController* documents = ICore::self() ? ICore::self()->documentController() : 0;
+        for(int i = 0; i < files.size(); ++i)
+        {
+            IDocument* document = documents ? documents->documentForUrl(QUrl::fromLocalFile(files[i])) : 0;
+            if(document && document->textDocument())
+                contents.append(document->textDocument()->text().toUtf8());
+            else
+            {
+                contents.append(QByteArray());
+                unopened.append(i);
+            }
+        }
+    }
+    for(int i : unopened)
+    {
+        QFile file(files[i]);
+        if(file.open(QIODevice::ReadOnly))
+            contents[i] = file.readAll();
+    }
+    return contents;
+}
+
+struct ScheduledImports
+{
+    QMutex mutex;
+    //imports of every document as of its last parse
+    QHash<IndexedString, QStringList> imports;
+};
+
+Q_GLOBAL_STATIC(ScheduledImports, scheduledImports)
+
+//remembers @p imports of @p url, returns true if they differ from those of its previous parse
+bool importsChanged(const IndexedString& url, QStringList imports)
+{
+    imports.sort();
+    ScheduledImports* data = scheduledImports;
+    QMutexLocker lock(&data->mutex);
+    auto iter = data->imports.find(url);
+    if(iter != data->imports.end() && *iter == imports)
+        return false;
+    data->imports.insert(url, imports);
+    return true;
+}
+
+//context of a file which hasn't changed since it was built with @p features
+ReferencedTopDUContext upToDateContext(const IndexedString& url, TopDUContext::Features features)
+{
+    DUChainReadLocker lock;
+    ParsingEnvironmentFilePointer file = DUChain::self()->environmentFileForDocument(url);
+    if(!file || file->language() != ParseSession::languageString() || file->needsUpdate() || !file->featuresSatisfied(features))
+        return ReferencedTopDUContext();
+    return ReferencedTopDUContext(file->topContext());
+}
+
+//files opened in editor are built with uses
+bool hasUses(const IndexedString& url)
+{
+    DUChainReadLocker lock;
+    TopDUContext* context = DUChain::self()->chainForDocument(url);
+    return context && (context->features() & TopDUContext::AllDeclarationsContextsAndUses) == TopDUContext::AllDeclarationsContextsAndUses;
+}
+
+}
 
 GoParseJob::GoParseJob(const KDevelop::IndexedString& url, KDevelop::ILanguageSupport* languageSupport): ParseJob(url, languageSupport)
 {
@@ -47,6 +141,11 @@ GoParseJob::GoParseJob(const KDevelop::IndexedString& url, KDevelop::ILanguageSu
 void GoParseJob::run(ThreadWeaver::JobPointer self, ThreadWeaver::Thread *thread)
 {
    qCDebug(Go) << "GoParseJob succesfully created for document " << document(); 
+    go::BuilderLockScope::Statistics lockStatistics = go::BuilderLockScope::threadStatistics();
+
+    QStringList package = packageFiles();
+    if(!package.empty())
+        return runForPackage(package);
 
    UrlParseLock urlLock(document());
 
@@ -65,9 +164,12 @@ void GoParseJob::run(ThreadWeaver::JobPointer self, ThreadWeaver::Thread *thread
 
     //ParseSession session(QString(contents().contents).toUtf8(), priority());
     ParseSession session(code, parsePriority());
+    session.setLexerBackend(ParseSession::HandWrittenLexer);
     
     session.setCurrentDocument(document());
     session.setFeatures(minimumFeatures());
+    //function bodies unchanged since last parse keep their contexts
+    session.setIncrementalParsing(true);
 
     if(abortRequested())
       return;
@@ -106,17 +208,29 @@ void GoParseJob::run(ThreadWeaver::JobPointer self, ThreadWeaver::Thread *thread
     else
         session.setIncludePaths(go::Helper::getSearchPaths());
 
-    if(canonicalImports.empty())
-        parseCanonicalImports();
-    session.setCanonicalImports(&canonicalImports);
+    //snapshot has to outlive the session, which keeps a pointer to its canonical imports
+    go::ImportEnvironment::SnapshotPointer environment = go::ImportEnvironment::snapshot();
+    session.setCanonicalImports(&environment->canonicalImports);
+    session.setModuleGraph(go::ModuleGraph::forDirectory(document().toUrl().adjusted(QUrl::RemoveFilename | QUrl::StripTrailingSlash).toLocalFile()));
+    //imports are scheduled as a whole graph, bottom up, so every file is parsed once its imports are ready
+    //edits which keep imports as they were, like most keystrokes, have nothing new to schedule
+    if(!forExport)
+    {
+        QStringList imports = go::Preamble::scan(code).imports;
+        if(importsChanged(document(), imports))
+            session.scheduleImportGraph(imports);
+    }
 
-    if(result)
+    //recovered AST lacks only broken parts, so the rest of the file still gets declarations
+    if(result || session.isRecovered())
     {
 	QReadLocker parseLock(languageSupport()->parseLock());
 	
 	if(abortRequested())
 	  return abortJob();
 	//qCDebug(Go) << QString(contents().contents);
+	//declarations and uses of this file share identifier lookups
+	go::LookupCache lookupCache;
 	DeclarationBuilder builder(&session, forExport);
 	context = builder.build(document(), session.ast(), context);
 	
@@ -125,105 +239,237 @@ void GoParseJob::run(ThreadWeaver::JobPointer self, ThreadWeaver::Thread *thread
 	    go::UseBuilder useBuilder(&session);
 	    useBuilder.buildUses(session.ast());
 	}
-	//this notifies other opened files of changes
-	//session.reparseImporters(context);
+	if(context)
+	    session.rememberFunctionBodies();
 	
     }
-    if(!context){
-        DUChainWriteLocker lock;
-	ParsingEnvironmentFile* file = new ParsingEnvironmentFile(document());
-	file->setLanguage(ParseSession::languageString());
-        context = new TopDUContext(document(), RangeInRevision(0, 0, INT_MAX, INT_MAX), file);
-	DUChain::self()->addDocumentChain(context);
-    }
-	
+    bool exportsChanged = false;
+    context = finishContext(context, document(), session, &exportsChanged);
     setDuChain(context);
-    {
-        DUChainWriteLocker lock;
-	context->setFeatures(minimumFeatures());
-        ParsingEnvironmentFilePointer file = context->parsingEnvironmentFile();
-	Q_ASSERT(file);
-	DUChain::self()->updateContextEnvironment(context->topContext(), file.data());
-    }
+    //imports resolved without canonical imports are resolved again when those are found
+    if(!forExport)
+        go::ImportEnvironment::documentParsed(document(), environment->version);
+    //this notifies other opened files of changes, edits that keep exports intact need no importer work
+    if(exportsChanged)
+        session.reparseImporters(context);
     highlightDUChain();
     
     if(result)
       qCDebug(Go) << "===Success===" << document().str();
     else
       qCDebug(Go) << "===Failed===" << document().str();
+    lockStatistics = go::BuilderLockScope::threadStatistics().since(lockStatistics);
+    qCDebug(Go) << "DUChain locked by builders of this job" << lockStatistics.acquisitions << "times," << lockStatistics.contended << "contended,"
+                << lockStatistics.nested << "nested, waited" << lockStatistics.waitedNanoseconds / 1000000 << "ms";
 }
 
-void GoParseJob::parseCanonicalImports()
+QStringList GoParseJob::packageFiles() const
 {
-    QList<QString> importPaths = go::Helper::getSearchPaths();
-    for(const QString& path : importPaths)
+    if((minimumFeatures() & TopDUContext::AllDeclarationsContextsAndUses) != TopDUContext::AllDeclarationsAndContexts)
+        return QStringList();
+    QString path = document().toUrl().toLocalFile();
+    go::PackageCache::Package package = go::PackageCache::package(document().toUrl().adjusted(QUrl::RemoveFilename | QUrl::StripTrailingSlash).toLocalFile());
+    if(!package.buildFiles.contains(path) || hasUses(document()))
+        return QStringList();
+    QStringList files;
+    for(const QString& file : package.buildFiles)
+    {
+        if(file == path || !hasUses(IndexedString(file)))
+            files.append(file);
+    }
+    return files.size() > 1 ? files : QStringList();
+}
+
+void GoParseJob::runForPackage(QStringList files)
+{
+    qCDebug(Go) << "Building package of " << document() << " with " << files.size() << " files";
+    //siblings which haven't changed since their last build only take part as package scope
+    QStringList packageFiles = files;
+    QList<ReferencedTopDUContext> upToDate;
+    TopDUContext::Features features = (TopDUContext::Features)(minimumFeatures() & TopDUContext::AllDeclarationsContextsAndUses);
+    for(const QString& file : packageFiles)
+    {
+        IndexedString url(file);
+        if(url == document())
+            continue;
+        ReferencedTopDUContext context = upToDateContext(url, features);
+        if(context)
+        {
+            upToDate.append(context);
+            files.removeOne(file);
+        }
+    }
+
+    //every package job takes locks in the same order, so they can't deadlock
+    std::sort(files.begin(), files.end());
+    std::vector<std::unique_ptr<UrlParseLock>> locks;
+    for(const QString& file : files)
+        locks.emplace_back(new UrlParseLock(IndexedString(file)));
+
+    if (abortRequested() || !isUpdateRequired(ParseSession::languageString())) {
+        return;
+    }
+
+    ProblemPointer p = readContents();
+    if(p) {
+	 return;
+    }
+
+    QList<QString> searchPaths = go::Helper::getSearchPaths();
+    go::ImportEnvironment::SnapshotPointer environment = go::ImportEnvironment::snapshot();
+    std::shared_ptr<const go::ModuleGraph> modules = go::ModuleGraph::forDirectory(document().toUrl().adjusted(QUrl::RemoveFilename | QUrl::StripTrailingSlash).toLocalFile());
+    QStringList siblings;
+    for(const QString& file : files)
+    {
+        if(IndexedString(file) != document())
+            siblings.append(file);
+    }
+    QList<QByteArray> siblingContents = readFiles(siblings);
+    std::vector<std::unique_ptr<ParseSession>> sessions;
+    std::vector<char> results(files.size(), false);
+    //background parser already runs a job per core, so files of package are parsed one after another
+    for(int i = 0; i < files.size(); ++i)
     {
-        QDirIterator iterator(path, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-        while(iterator.hasNext())
+        IndexedString url(files[i]);
+        QByteArray code = url == document() ? contents().contents : siblingContents.at(siblings.indexOf(files[i]));
+        while(code.endsWith('\0'))
+            code.chop(1);
+        sessions.emplace_back(new ParseSession(code, parsePriority()));
+        ParseSession* session = sessions.back().get();
+        session->setLexerBackend(ParseSession::HandWrittenLexer);
+        session->setCurrentDocument(url);
+        session->setFeatures(minimumFeatures());
+        session->setIncludePaths(searchPaths);
+        session->setCanonicalImports(&environment->canonicalImports);
+        session->setModuleGraph(modules);
+        results[i] = session->startParsing();
+    }
+
+    QList<ReferencedTopDUContext> contexts;
+    {
+	QReadLocker parseLock(languageSupport()->parseLock());
+
+	if(abortRequested())
+	  return abortJob();
+
+        //forward declarations of every file come first, so each file is built once against all of them
+        std::vector<std::unique_ptr<DeclarationBuilder>> builders;
+        for(int i = 0; i < files.size(); ++i)
         {
-            iterator.next();
-            QDir dir(iterator.filePath());
-            for(const QString& file : dir.entryList(QStringList("*.go"), QDir::Files | QDir::NoSymLinks))
+            IndexedString url(files[i]);
+            ReferencedTopDUContext context;
+            {
+                DUChainReadLocker lock;
+                context = DUChainUtils::standardContextForUrl(url.toUrl());
+            }
+            if(context && url == document())
+                translateDUChainToRevision(context);
+            if(context)
             {
-                QFile f(dir.filePath(file));
-                f.open(QIODevice::ReadOnly);
-                QByteArray contents = f.readAll();
-                f.close();
-                QString canonicalImport = extractCanonicalImport(QString(contents));
-                if(canonicalImport.length() != 0)
+                DUChainWriteLocker lock;
+                context->setRange(RangeInRevision(0, 0, INT_MAX, INT_MAX));
+            }
+            builders.emplace_back();
+            if(results[i] || sessions[i]->isRecovered())
+            {
+                go::LookupCache lookupCache;
+                builders.back().reset(new DeclarationBuilder(sessions[i].get(), true));
+                builders.back()->setPackageContexts(QList<ReferencedTopDUContext>());
+                context = builders.back()->forwardDeclare(url, sessions[i]->ast(), context);
+            }
+            contexts.append(context);
+        }
+        QList<ReferencedTopDUContext> package = upToDate;
+        for(const ReferencedTopDUContext& context : contexts)
+        {
+            if(context)
+                package.append(context);
+        }
+        for(int i = 0; i < files.size(); ++i)
+        {
+            if(!builders[i])
+                continue;
+            go::LookupCache lookupCache;
+            builders[i]->setPackageContexts(package);
+            contexts[i] = builders[i]->build(IndexedString(files[i]), sessions[i]->ast(), contexts[i]);
+        }
+        //files which weren't built keep their imports, link those of them which miss a new file
+        DUChainWriteLocker lock;
+        for(const ReferencedTopDUContext& context : upToDate)
+        {
+            bool linked = false;
+            for(const ReferencedTopDUContext& built : contexts)
+            {
+                if(built && !context->imports(built.data()))
                 {
-                    qCDebug(Go) << "Found canonical import for package " << iterator.filePath() << " import: " << canonicalImport;
-                    canonicalImports[canonicalImport] = iterator.filePath();
-                    break;
+                    context->addImportedParentContext(built.data());
+                    linked = true;
                 }
             }
+            if(linked)
+                context->updateImportsCache();
         }
     }
-    //if no canonical imports were found add stab value to map
-    //so we won't search for them again
-    if(canonicalImports.empty())
-        canonicalImports["<?>"] = QString("none");
+
+    QList<ReferencedTopDUContext> changed;
+    for(int i = 0; i < files.size(); ++i)
+    {
+        IndexedString url(files[i]);
+        bool exportsChanged = false;
+        ReferencedTopDUContext context = finishContext(contexts[i], url, *sessions[i], &exportsChanged);
+        if(exportsChanged)
+            changed.append(context);
+        if(url == document())
+            setDuChain(context);
+    }
+    //opened files using this package are notified, the package itself is complete already
+    if(!changed.isEmpty())
+        sessions.front()->reparsePackageImporters(changed, packageFiles);
+    highlightDUChain();
+    qCDebug(Go) << "Built" << files.size() << "of" << packageFiles.size() << "files of package";
 }
 
-QString GoParseJob::extractCanonicalImport(QString string)
+ReferencedTopDUContext GoParseJob::finishContext(ReferencedTopDUContext context, const IndexedString& url, ParseSession& session, bool* exportsChanged)
 {
-    int i = 0;
-    while(i < string.length())
+    //merged tables of its package and packages it imports may be outdated now
+    go::PackageSymbolTable::invalidate(url);
+    if(!context){
+        DUChainWriteLocker lock;
+	ParsingEnvironmentFile* file = new go::GoParsingEnvironmentFile(url);
+	file->setLanguage(ParseSession::languageString());
+        context = new TopDUContext(url, RangeInRevision(0, 0, INT_MAX, INT_MAX), file);
+	DUChain::self()->addDocumentChain(context);
+    }
+	
     {
-       if(string[i].isSpace())
-           i++;
-       else if(string[i] == '/')
-       {
-           if(i + 1 < string.length() && string[i+1] == '/')
-           {
-               i += 2;
-               while(i<string.length() && string[i] != '\n')
-                   ++i;
-               ++i;
-           }
-           else if(i + 1 < string.length() && string[i+1] == '*')
-           {
-               i += 2;
-               while(i+1<string.length() && !(string[i] == '*' && string[i+1] == '/'))
-                   ++i;
-               i+=2;
-           }else
-               return QString("");
-       }else if(string[i] == 'p')
-       {
-           string = string.mid(i);
-           //match "package name // or /* import \" "
-           if(string.indexOf(QRegExp("^package\\s*\\w*\\s*(//|/\\*)\\s*import\\s*\"")) == 0)
-           {
-               int nameStart = string.indexOf("\"")+1;
-               int nameEnd = string.indexOf("\"", nameStart);
-               if(nameStart != -1 && nameEnd != -1)
-                   return string.mid(nameStart, nameEnd - nameStart);
-           }
-           return QString("");
-       }else
-           return QString("");
-    }
-    return QString("");
+        DUChainWriteLocker lock;
+	context->setFeatures(minimumFeatures());
+        context->clearProblems();
+        for(const RangeInRevision& range : session.syntaxErrors())
+        {
+            ProblemPointer problem(new Problem());
+            problem->setSource(IProblem::Parser);
+            problem->setSeverity(IProblem::Error);
+            problem->setDescription(i18n("Syntax error"));
+            problem->setFinalLocation(DocumentRange(url, range.castToSimpleRange()));
+            context->addProblem(problem);
+        }
+        ParsingEnvironmentFilePointer file = context->parsingEnvironmentFile();
+	Q_ASSERT(file);
+        go::GoParsingEnvironmentFile* goFile = dynamic_cast<go::GoParsingEnvironmentFile*>(file.data());
+        if(!goFile)
+        {//chains stored by older versions
+            goFile = new go::GoParsingEnvironmentFile(url);
+            goFile->setLanguage(ParseSession::languageString());
+            goFile->setFeatures(file->features());
+            file = ParsingEnvironmentFilePointer(goFile);
+            context->setParsingEnvironmentFile(goFile);
+        }
+        quint64 fingerprint = go::GoParsingEnvironmentFile::fingerprintExports(context);
+        if(exportsChanged)
+            *exportsChanged = goFile->exportFingerprint() != 0 && goFile->exportFingerprint() != fingerprint;
+        goFile->setExportFingerprint(fingerprint);
+	DUChain::self()->updateContextEnvironment(context->topContext(), file.data());
+    }
+    return context;
 }
-
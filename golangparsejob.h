@@ -21,6 +21,10 @@
 
 #include <language/backgroundparser/parsejob.h>
 
+#include <QStringList>
+
+class ParseSession;
+
 class GoParseJob : public KDevelop::ParseJob
 {
 public:
@@ -32,20 +36,24 @@ protected:
 
 private:
     /**
-     * Parses every .go file available in search paths,
-     * looks for declarations like ` package pack //import "my_pack" `
-     * which means that package pack must be imported under name my_pack.
-     * Canonical imports paths should be available before any other parsing
-     * can begin, so it must be fast.
-     **/
-    void parseCanonicalImports();
+     * Returns build files of package of this document if this job builds all of them together.
+     * This is done for imported packages only, files built with uses are left to their own jobs.
+     */
+    QStringList packageFiles() const;
 
     /**
-     * extracts package's canonical import name.
-     **/
-    QString extractCanonicalImport(QString string);
-    static QHash<QString, QString> canonicalImports;
+     * Parses @p files, forward declares their symbols and then builds each of them once
+     * against all of them, so package is complete after a single job instead of rounds of reparsing single files.
+     * Files which haven't changed since their last build are not built again, only linked with the others.
+     */
+    void runForPackage(QStringList files);
 
+    /**
+     * Stores features, problems and export fingerprint of built @p context, creating an empty context if there is none.
+     * @p exportsChanged is set if fingerprint differs from the one of previous build.
+     */
+    KDevelop::ReferencedTopDUContext finishContext(KDevelop::ReferencedTopDUContext context, const KDevelop::IndexedString& url,
+                                                   ParseSession& session, bool* exportsChanged = 0);
 };
 
 #endif
\ No newline at end of file
@@ -24,8 +24,10 @@
 #include <language/codecompletion/codecompletion.h>
 #include <interfaces/icore.h>
 #include <interfaces/ilanguagecontroller.h>
+#include <interfaces/iprojectcontroller.h>
 
 #include "codecompletion/model.h"
+#include "duchain/importenvironment.h"
 #include "golangparsejob.h"
 
 K_PLUGIN_FACTORY_WITH_JSON(GoPluginFactory, "kdevgo.json", registerPlugin<GoPlugin>(); )
@@ -45,6 +47,13 @@ GoPlugin::GoPlugin(QObject* parent, const QVariantList&)
     new KDevelop::CodeCompletion(this, codeCompletion, name());
 
     m_highlighting = new Highlighting(this);
+
+    //GOPATH walk for canonical imports is done in the background,
+    //and done again when opened projects change, since they can bring their own packages
+    go::ImportEnvironment::initialize();
+    IProjectController* projects = ICore::self()->projectController();
+    connect(projects, &IProjectController::projectOpened, this, [] { go::ImportEnvironment::scheduleRefresh(); });
+    connect(projects, &IProjectController::projectClosed, this, [] { go::ImportEnvironment::scheduleRefresh(); });
 }
 
 GoPlugin::~GoPlugin()
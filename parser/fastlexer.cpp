@@ -0,0 +1,772 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "fastlexer.h"
+
+#include "parser/golexer.h"
+#include "parser/goparser.h"
+
+#include <QChar>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+using go::Parser;
+
+enum CharClass : unsigned char
+{
+    Other,
+    Letter,
+    Digit,
+    Blank,
+    Newline,
+    NonAscii
+};
+
+struct CharClasses
+{
+    CharClasses()
+    {
+        memset(table, Other, sizeof(table));
+        for(int c = 'a'; c <= 'z'; ++c)
+            table[c] = Letter;
+        for(int c = 'A'; c <= 'Z'; ++c)
+            table[c] = Letter;
+        table[static_cast<unsigned char>('_')] = Letter;
+        for(int c = '0'; c <= '9'; ++c)
+            table[c] = Digit;
+        table[static_cast<unsigned char>(' ')] = Blank;
+        table[static_cast<unsigned char>('\t')] = Blank;
+        table[static_cast<unsigned char>('\n')] = Newline;
+        for(int c = 0x80; c < 0x100; ++c)
+            table[c] = NonAscii;
+    }
+
+    unsigned char table[256];
+};
+
+const CharClasses classes;
+
+inline unsigned char classOf(char c)
+{
+    return classes.table[static_cast<unsigned char>(c)];
+}
+
+struct Keyword
+{
+    const char* text;
+    int length;
+    int kind;
+};
+
+const Keyword keywords[] = {
+    {"break", 5, Parser::Token_BREAK}, {"case", 4, Parser::Token_CASE}, {"chan", 4, Parser::Token_CHAN},
+    {"const", 5, Parser::Token_CONST}, {"continue", 8, Parser::Token_CONTINUE}, {"default", 7, Parser::Token_DEFAULT},
+    {"defer", 5, Parser::Token_DEFER}, {"else", 4, Parser::Token_ELSE}, {"fallthrough", 11, Parser::Token_FALLTHROUGH},
+    {"for", 3, Parser::Token_FOR}, {"func", 4, Parser::Token_FUNC}, {"go", 2, Parser::Token_GO},
+    {"goto", 4, Parser::Token_GOTO}, {"if", 2, Parser::Token_IF}, {"import", 6, Parser::Token_IMPORT},
+    {"interface", 9, Parser::Token_INTERFACE}, {"map", 3, Parser::Token_MAP}, {"package", 7, Parser::Token_PACKAGE},
+    {"range", 5, Parser::Token_RANGE}, {"return", 6, Parser::Token_RETURN}, {"select", 6, Parser::Token_SELECT},
+    {"struct", 6, Parser::Token_STRUCT}, {"switch", 6, Parser::Token_SWITCH}, {"type", 4, Parser::Token_TYPE},
+    {"var", 3, Parser::Token_VAR}
+};
+
+int identifierKind(const char* text, qint64 length)
+{
+    if(length < 2 || length > 11 || text[0] < 'b' || text[0] > 'v')
+        return Parser::Token_IDENT;
+    for(const Keyword& keyword : keywords)
+    {
+        if(keyword.length == length && keyword.text[0] == text[0] && memcmp(keyword.text, text, length) == 0)
+            return keyword.kind;
+    }
+    return Parser::Token_IDENT;
+}
+
+//same set of tokens go.g checks before inserting semicolon
+inline bool insertsSemicolon(int kind)
+{
+    switch(kind)
+    {
+    case Parser::Token_IDENT: case Parser::Token_INTEGER: case Parser::Token_FLOAT:
+    case Parser::Token_COMPLEX: case Parser::Token_RUNE: case Parser::Token_STRING:
+    case Parser::Token_BREAK: case Parser::Token_CONTINUE: case Parser::Token_FALLTHROUGH:
+    case Parser::Token_RETURN: case Parser::Token_PLUSPLUS: case Parser::Token_MINUSMINUS:
+    case Parser::Token_RPAREN: case Parser::Token_RBRACKET: case Parser::Token_RBRACE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Returns length of UTF-8 sequence at @p p and stores decoded code point in @p codePoint.
+ * Invalid bytes are treated as single characters.
+ */
+int decodeUtf8(const char* p, const char* limit, uint* codePoint)
+{
+    unsigned char lead = static_cast<unsigned char>(*p);
+    int length = 1;
+    uint value = lead;
+    if(lead >= 0xf0 && lead < 0xf8)
+    {
+        length = 4;
+        value = lead & 0x07;
+    }
+    else if(lead >= 0xe0)
+    {
+        length = 3;
+        value = lead & 0x0f;
+    }
+    else if(lead >= 0xc0)
+    {
+        length = 2;
+        value = lead & 0x1f;
+    }
+    if(length == 1 || limit - p < length)
+    {
+        *codePoint = lead;
+        return 1;
+    }
+    for(int i = 1; i < length; ++i)
+    {
+        unsigned char next = static_cast<unsigned char>(p[i]);
+        if((next & 0xc0) != 0x80)
+        {
+            *codePoint = lead;
+            return 1;
+        }
+        value = (value << 6) | (next & 0x3f);
+    }
+    *codePoint = value;
+    return length;
+}
+
+inline bool isNonAsciiLetter(const char* p, const char* limit, int* length)
+{
+    uint codePoint;
+    *length = decodeUtf8(p, limit, &codePoint);
+    return codePoint >= 0x80 && QChar::isLetter(codePoint);
+}
+
+inline qint64 countDigits(const char* p, const char* limit)
+{
+    const char* start = p;
+    while(p < limit && *p >= '0' && *p <= '9')
+        ++p;
+    return p - start;
+}
+
+inline qint64 countOctalDigits(const char* p, const char* limit)
+{
+    const char* start = p;
+    while(p < limit && *p >= '0' && *p <= '7')
+        ++p;
+    return p - start;
+}
+
+inline bool isHexDigit(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+inline qint64 countHexDigits(const char* p, const char* limit)
+{
+    const char* start = p;
+    while(p < limit && isHexDigit(*p))
+        ++p;
+    return p - start;
+}
+
+inline bool hasHexDigits(const char* p, const char* limit, int count)
+{
+    return limit - p >= count && countHexDigits(p, p + count) == count;
+}
+
+//length of {exponent} from go.g at p, or 0
+qint64 exponentLength(const char* p, const char* limit)
+{
+    if(p >= limit || (*p != 'e' && *p != 'E'))
+        return 0;
+    const char* q = p + 1;
+    if(q < limit && (*q == '+' || *q == '-'))
+        ++q;
+    qint64 digits = countDigits(q, limit);
+    if(digits == 0)
+        return 0;
+    return q + digits - p;
+}
+
+/**
+ * Longest match of INTEGER, FLOAT and COMPLEX rules at a digit,
+ * in case of equal lengths earlier rule wins just as in generated lexer.
+ */
+qint64 numberLength(const char* p, const char* limit, int* kind)
+{
+    qint64 digits = countDigits(p, limit);
+    qint64 length;
+    //INTEGER
+    if(*p != '0')
+        length = digits;
+    else
+    {
+        length = 1 + countOctalDigits(p + 1, limit);
+        if(p + 1 < limit && (p[1] == 'x' || p[1] == 'X'))
+        {
+            qint64 hex = countHexDigits(p + 2, limit);
+            if(hex > 0 && hex + 2 > length)
+                length = hex + 2;
+        }
+    }
+    *kind = Parser::Token_INTEGER;
+    //FLOAT
+    qint64 floatLength = 0;
+    if(p + digits < limit && p[digits] == '.')
+    {
+        floatLength = digits + 1 + countDigits(p + digits + 1, limit);
+        floatLength += exponentLength(p + floatLength, limit);
+    }
+    else
+    {
+        qint64 exponent = exponentLength(p + digits, limit);
+        if(exponent > 0)
+            floatLength = digits + exponent;
+    }
+    if(floatLength > length)
+    {
+        length = floatLength;
+        *kind = Parser::Token_FLOAT;
+    }
+    //COMPLEX
+    if(p + digits < limit && p[digits] == 'i' && digits + 1 > length)
+    {
+        length = digits + 1;
+        *kind = Parser::Token_COMPLEX;
+    }
+    if(floatLength > 0 && p + floatLength < limit && p[floatLength] == 'i' && floatLength + 1 > length)
+    {
+        length = floatLength + 1;
+        *kind = Parser::Token_COMPLEX;
+    }
+    return length;
+}
+
+/**
+ * Longest RUNE match at a quote or 0.
+ * Rune content is either one of escape sequences or any single character,
+ * including a quote or a backslash, followed by a closing quote.
+ */
+qint64 runeLength(const char* p, const char* limit)
+{
+    const char* q = p + 1;
+    if(q >= limit)
+        return 0;
+    qint64 best = 0;
+    auto tryContent = [&](qint64 length) {
+        if(q + length < limit && q[length] == '\'' && length + 2 > best)
+            best = length + 2;
+    };
+    if(*q == '\\' && q + 1 < limit)
+    {
+        char c = q[1];
+        if(limit - q >= 4 && countOctalDigits(q + 1, q + 4) == 3)
+            tryContent(4);
+        if(c == 'x' && hasHexDigits(q + 2, limit, 2))
+            tryContent(4);
+        if(c == 'u' && hasHexDigits(q + 2, limit, 4))
+            tryContent(6);
+        if(c == 'U' && hasHexDigits(q + 2, limit, 8))
+            tryContent(10);
+        if(c != '\0' && strchr("abfnrtv\\'\"", c))
+            tryContent(2);
+    }
+    uint codePoint;
+    tryContent(decodeUtf8(q, limit, &codePoint));
+    return best;
+}
+
+/**
+ * Finds first quote or backslash in [p, limit), returns limit if there is none.
+ */
+const char* findStringSpecial(const char* p, const char* limit)
+{
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while(limit - p >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+        if(mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while(p < limit && *p != '"' && *p != '\\')
+        ++p;
+    return p;
+}
+
+/**
+ * Length of interpreted string literal at a double quote or 0 if it's never closed.
+ * Strings may contain newlines, as in go.g.
+ */
+qint64 stringLength(const char* p, const char* limit)
+{
+    const char* q = p + 1;
+    while(true)
+    {
+        q = findStringSpecial(q, limit);
+        if(q >= limit)
+            return 0;
+        if(*q == '"')
+            return q + 1 - p;
+        //backslash escapes any following character
+        if(q + 1 >= limit)
+            return 0;
+        q += 2;
+    }
+}
+
+const char* findCommentEnd(const char* p, const char* limit)
+{
+    while(p < limit)
+    {
+        const char* star = static_cast<const char*>(memchr(p, '*', limit - p));
+        if(!star || star + 1 >= limit)
+            return limit;
+        if(star[1] == '/')
+            return star;
+        p = star + 1;
+    }
+    return limit;
+}
+
+/**
+ * Length of an operator at @p p or 0 for unknown symbol.
+ * Slashes, dots, braces and quotes are handled by the caller.
+ */
+int operatorLength(const char* p, const char* limit, int* kind)
+{
+    char next = p + 1 < limit ? p[1] : '\0';
+    char afterNext = p + 2 < limit ? p[2] : '\0';
+    switch(*p)
+    {
+    case '+':
+        if(next == '=') { *kind = Parser::Token_PLUSEQUAL; return 2; }
+        if(next == '+') { *kind = Parser::Token_PLUSPLUS; return 2; }
+        *kind = Parser::Token_PLUS; return 1;
+    case '-':
+        if(next == '=') { *kind = Parser::Token_MINUSEQUAL; return 2; }
+        if(next == '-') { *kind = Parser::Token_MINUSMINUS; return 2; }
+        *kind = Parser::Token_MINUS; return 1;
+    case '&':
+        if(next == '^' && afterNext == '=') { *kind = Parser::Token_AMPERXOREQUAL; return 3; }
+        if(next == '^') { *kind = Parser::Token_AMPERXOR; return 2; }
+        if(next == '=') { *kind = Parser::Token_AMPEREQUAL; return 2; }
+        if(next == '&') { *kind = Parser::Token_LOGICALAND; return 2; }
+        *kind = Parser::Token_AMPERSAND; return 1;
+    case '|':
+        if(next == '=') { *kind = Parser::Token_OREQUAL; return 2; }
+        if(next == '|') { *kind = Parser::Token_LOGICALOR; return 2; }
+        *kind = Parser::Token_BITWISEOR; return 1;
+    case '=':
+        if(next == '=') { *kind = Parser::Token_ISEQUAL; return 2; }
+        *kind = Parser::Token_ASSIGN; return 1;
+    case '!':
+        if(next == '=') { *kind = Parser::Token_ISNOTEQUAL; return 2; }
+        *kind = Parser::Token_BANG; return 1;
+    case '<':
+        if(next == '<' && afterNext == '=') { *kind = Parser::Token_LEFTSHIFTEQUAL; return 3; }
+        if(next == '<') { *kind = Parser::Token_LEFTSHIFT; return 2; }
+        if(next == '=') { *kind = Parser::Token_LESSOREQUAL; return 2; }
+        if(next == '-') { *kind = Parser::Token_LEFTCHAN; return 2; }
+        *kind = Parser::Token_LESS; return 1;
+    case '>':
+        if(next == '>' && afterNext == '=') { *kind = Parser::Token_RIGHTSHIFTEQUAL; return 3; }
+        if(next == '>') { *kind = Parser::Token_RIGHTSHIFT; return 2; }
+        if(next == '=') { *kind = Parser::Token_GREATEROREQUAL; return 2; }
+        *kind = Parser::Token_GREATER; return 1;
+    case '*':
+        if(next == '=') { *kind = Parser::Token_MULTIPLYEQUAL; return 2; }
+        *kind = Parser::Token_STAR; return 1;
+    case '^':
+        if(next == '=') { *kind = Parser::Token_XOREQUAL; return 2; }
+        *kind = Parser::Token_HAT; return 1;
+    case '%':
+        if(next == '=') { *kind = Parser::Token_MODEQUAL; return 2; }
+        *kind = Parser::Token_MOD; return 1;
+    case ':':
+        if(next == '=') { *kind = Parser::Token_AUTOASSIGN; return 2; }
+        *kind = Parser::Token_COLON; return 1;
+    case '(': *kind = Parser::Token_LPAREN; return 1;
+    case ')': *kind = Parser::Token_RPAREN; return 1;
+    case '[': *kind = Parser::Token_LBRACKET; return 1;
+    case ']': *kind = Parser::Token_RBRACKET; return 1;
+    case '{': *kind = Parser::Token_LBRACE; return 1;
+    case ',': *kind = Parser::Token_COMMA; return 1;
+    case ';': *kind = Parser::Token_SEMICOLON; return 1;
+    default:
+        return 0;
+    }
+}
+
+QThreadPool* lexerThreadPool()
+{
+    //own pool, so lexing never waits behind unrelated tasks of the global one
+    static QThreadPool pool;
+    return &pool;
+}
+
+}
+
+namespace go
+{
+
+class FastLexer::ChunkJob : public QRunnable
+{
+public:
+    ChunkJob(const FastLexer* lexer, qint64 begin, qint64 end, Output* output, QSemaphore* done)
+        : m_lexer(lexer), m_begin(begin), m_end(end), m_output(output), m_done(done)
+    {
+    }
+
+    void run() override
+    {
+        //chunks start right after a newline, where semicolon has either been inserted or not needed,
+        //so they are lexed as if there were no previous token
+        m_lexer->lexRange(m_begin, m_end, -1, *m_output);
+        m_done->release();
+    }
+
+private:
+    const FastLexer* m_lexer;
+    qint64 m_begin;
+    qint64 m_end;
+    Output* m_output;
+    QSemaphore* m_done;
+};
+
+FastLexer::FastLexer(const QByteArray& contents) : m_contents(contents), m_parallelThreshold(DefaultParallelThreshold)
+{
+}
+
+void FastLexer::setParallelThreshold(qint64 bytes)
+{
+    m_parallelThreshold = bytes;
+}
+
+bool FastLexer::tokenize(go::Lexer* target)
+{
+    QVector<Output> outputs;
+    if(m_contents.size() >= m_parallelThreshold && QThread::idealThreadCount() > 1)
+        outputs = lexChunks();
+    else
+    {
+        outputs.resize(1);
+        lexRange(0, m_contents.size(), -1, outputs[0]);
+    }
+
+    bool success = true;
+    for(const Output& output : outputs)
+    {
+        for(const KDevPG::Token& token : output.tokens)
+            target->push() = token;
+    }
+    KDevPG::Token& eof = target->push();
+    eof.kind = Parser::Token_EOF;
+    eof.begin = m_contents.size();
+    eof.end = m_contents.size();
+    for(const Output& output : outputs)
+    {
+        for(qint64 newline : output.newlines)
+            target->locationTable()->newline(newline);
+        if(!output.errors.isEmpty())
+            success = false;
+        if(target->errorCallback)
+        {
+            for(qint64 error : output.errors)
+                target->errorCallback(error);
+        }
+    }
+    return success;
+}
+
+QVector<qint64> FastLexer::chunkBoundaries() const
+{
+    const char* data = m_contents.constData();
+    qint64 size = m_contents.size();
+    qint64 minChunkSize = qMax<qint64>(1, m_parallelThreshold / 4);
+    int chunks = qMax<qint64>(2, qMin<qint64>(QThread::idealThreadCount(), size / minChunkSize));
+
+    QVector<qint64> boundaries;
+    boundaries.append(0);
+    for(int i = 1; i < chunks; ++i)
+    {
+        qint64 approximate = size * i / chunks;
+        if(approximate <= boundaries.last())
+            continue;
+        const char* newline = static_cast<const char*>(memchr(data + approximate, '\n', size - approximate));
+        if(!newline)
+            break;
+        qint64 boundary = newline + 1 - data;
+        if(boundary >= size)
+            break;
+        if(boundary > boundaries.last())
+            boundaries.append(boundary);
+    }
+    boundaries.append(size);
+    return boundaries;
+}
+
+QVector<FastLexer::Output> FastLexer::lexChunks() const
+{
+    QVector<qint64> boundaries = chunkBoundaries();
+    int chunks = boundaries.size() - 1;
+    QVector<Output> outputs(chunks);
+    QThreadPool* pool = lexerThreadPool();
+    QSemaphore done;
+    for(int i = 1; i < chunks; ++i)
+        pool->start(new ChunkJob(this, boundaries[i], boundaries[i + 1], &outputs[i], &done));
+    lexRange(0, boundaries[1], -1, outputs[0]);
+    done.acquire(chunks - 1);
+
+    //Chunk was lexed assuming its first line starts outside of comments and literals.
+    //That's true if previous chunk stopped exactly at the boundary: the newline before it was
+    //then consumed by newline rule. Otherwise a comment, raw string or multiline string runs over
+    //the boundary, and the chunk is lexed again from where previous one actually stopped.
+    int lastKind = outputs[0].tokens.isEmpty() ? -1 : outputs[0].tokens.last().kind;
+    for(int i = 1; i < chunks; ++i)
+    {
+        qint64 stoppedAt = outputs[i - 1].endPosition;
+        if(stoppedAt != boundaries[i])
+        {
+            outputs[i] = Output();
+            if(stoppedAt < boundaries[i + 1])
+                lexRange(stoppedAt, boundaries[i + 1], lastKind, outputs[i]);
+            else
+                outputs[i].endPosition = stoppedAt;
+        }
+        if(!outputs[i].tokens.isEmpty())
+            lastKind = outputs[i].tokens.last().kind;
+    }
+    return outputs;
+}
+
+void FastLexer::lexRange(qint64 begin, qint64 end, int lastKind, Output& output) const
+{
+    const char* data = m_contents.constData();
+    const char* limit = data + m_contents.size();
+    const char* stop = data + end;
+    const char* p = data + begin;
+    //lastKind is the kind of the last token for semicolon insertion, -1 when there are no tokens yet
+
+    auto push = [&](int kind, const char* from, const char* to) {
+        KDevPG::Token token;
+        token.kind = kind;
+        token.begin = from - data;
+        token.end = to - data - 1;
+        output.tokens.append(token);
+        lastKind = kind;
+    };
+    auto registerNewlines = [&](const char* from, const char* to) {
+        while(from < to)
+        {
+            const char* newline = static_cast<const char*>(memchr(from, '\n', to - from));
+            if(!newline)
+                break;
+            output.newlines.append(newline + 1 - data);
+            from = newline + 1;
+        }
+    };
+    auto unknownSymbol = [&](const char* from) {
+        uint codePoint;
+        const char* to = from + decodeUtf8(from, limit, &codePoint);
+        push(Parser::Token_TEST, from, to);
+        output.errors.append(to - 1 - data);
+        return to;
+    };
+
+    while(p < stop)
+    {
+        const char* start = p;
+        switch(classOf(*p))
+        {
+        case Blank:
+            ++p;
+            while(p < limit && (*p == ' ' || *p == '\t'))
+                ++p;
+            break;
+        case Newline:
+            output.newlines.append(p + 1 - data);
+            if(lastKind != -1 && insertsSemicolon(lastKind))
+                push(Parser::Token_SEMICOLON, p, p + 1);
+            ++p;
+            break;
+        case Letter:
+        case NonAscii:
+        {
+            int length;
+            if(classOf(*p) == NonAscii && !isNonAsciiLetter(p, limit, &length))
+            {
+                p = unknownSymbol(p);
+                break;
+            }
+            while(p < limit)
+            {
+                unsigned char charClass = classOf(*p);
+                if(charClass == Letter || charClass == Digit)
+                    ++p;
+                else if(charClass == NonAscii && isNonAsciiLetter(p, limit, &length))
+                    p += length;
+                else
+                    break;
+            }
+            push(identifierKind(start, p - start), start, p);
+            break;
+        }
+        case Digit:
+        {
+            int kind;
+            p += numberLength(p, limit, &kind);
+            push(kind, start, p);
+            break;
+        }
+        default:
+            switch(*p)
+            {
+            case '/':
+                if(p + 1 < limit && p[1] == '/')
+                {
+                    const char* newline = static_cast<const char*>(memchr(p, '\n', limit - p));
+                    p = newline ? newline : limit;
+                }
+                else if(p + 1 < limit && p[1] == '*')
+                {
+                    const char* commentEnd = findCommentEnd(p + 2, limit);
+                    registerNewlines(p + 2, commentEnd);
+                    p = commentEnd < limit ? commentEnd + 2 : limit;
+                }
+                else if(p + 1 < limit && p[1] == '=')
+                {
+                    p += 2;
+                    push(Parser::Token_DIVIDEEQUAL, start, p);
+                }
+                else
+                {
+                    p += 1;
+                    push(Parser::Token_DIVIDE, start, p);
+                }
+                break;
+            case '.':
+                if(p + 1 < limit && classOf(p[1]) == Digit)
+                {
+                    const char* q = p + 1;
+                    q += countDigits(q, limit);
+                    q += exponentLength(q, limit);
+                    if(q < limit && *q == 'i')
+                    {
+                        p = q + 1;
+                        push(Parser::Token_COMPLEX, start, p);
+                    }
+                    else
+                    {
+                        p = q;
+                        push(Parser::Token_FLOAT, start, p);
+                    }
+                }
+                else if(p + 2 < limit && p[1] == '.' && p[2] == '.')
+                {
+                    p += 3;
+                    push(Parser::Token_TRIPLEDOT, start, p);
+                }
+                else
+                {
+                    p += 1;
+                    push(Parser::Token_DOT, start, p);
+                }
+                break;
+            case '}':
+                if(lastKind != -1 && insertsSemicolon(lastKind))
+                    push(Parser::Token_SEMICOLON, p, p + 1);
+                p += 1;
+                push(Parser::Token_RBRACE, start, p);
+                break;
+            case '"':
+            {
+                qint64 length = stringLength(p, limit);
+                if(length == 0)
+                {
+                    p = unknownSymbol(p);
+                    break;
+                }
+                p += length;
+                push(Parser::Token_STRING, start, p);
+                break;
+            }
+            case '`':
+            {
+                //like go.g, STRING token covers only the opening backtick
+                push(Parser::Token_STRING, p, p + 1);
+                const char* closing = static_cast<const char*>(memchr(p + 1, '`', limit - p - 1));
+                const char* stringEnd = closing ? closing : limit;
+                registerNewlines(p + 1, stringEnd);
+                p = closing ? closing + 1 : limit;
+                break;
+            }
+            case '\'':
+            {
+                qint64 length = runeLength(p, limit);
+                if(length == 0)
+                {
+                    p = unknownSymbol(p);
+                    break;
+                }
+                p += length;
+                push(Parser::Token_RUNE, start, p);
+                break;
+            }
+            default:
+            {
+                int kind;
+                int length = operatorLength(p, limit, &kind);
+                if(length == 0)
+                {
+                    p = unknownSymbol(p);
+                    break;
+                }
+                p += length;
+                push(kind, start, p);
+            }
+            }
+        }
+    }
+    output.endPosition = p - data;
+}
+
+}
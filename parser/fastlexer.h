@@ -0,0 +1,96 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGFASTLEXER_H
+#define GOLANGFASTLEXER_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include "goparserexport.h"
+#include "kdev-pg-token-stream.h"
+
+namespace go
+{
+class Lexer;
+
+/**
+ * Hand-written alternative to lexer generated from go.g.
+ * It produces exactly the same tokens(including inserted semicolons and TEST tokens for unknown symbols)
+ * and registers the same newlines in location table, but classifies ASCII with a lookup table
+ * and skips comments, strings and raw strings with memchr and SSE2 scans instead of going
+ * through the rule automaton character by character.
+ *
+ * Tokens are appended to an existing go::Lexer, so parser and everything else using
+ * token stream interface don't need to know which lexer produced them.
+ */
+class KDEVGOPARSER_EXPORT FastLexer
+{
+public:
+    /**
+     * Files at least this big are split into chunks which are lexed on several threads.
+     */
+    static const qint64 DefaultParallelThreshold = 1024 * 1024;
+
+    explicit FastLexer(const QByteArray& contents);
+
+    void setParallelThreshold(qint64 bytes);
+
+    /**
+     * Lexes whole contents and appends tokens, ending with EOF token, to @p target.
+     * @p target should be created over empty input, so reading past EOF doesn't lex anything else.
+     * Offsets of unknown symbols are passed to target's error callback.
+     * Returns false if there were unknown symbols.
+     */
+    bool tokenize(go::Lexer* target);
+
+private:
+    class ChunkJob;
+
+    struct Output
+    {
+        QVector<KDevPG::Token> tokens;
+        //offsets passed to LocationTable::newline()
+        QVector<qint64> newlines;
+        QVector<qint64> errors;
+        //offset where lexing actually stopped, last token may run past requested end
+        qint64 endPosition;
+    };
+
+    /**
+     * Lexes tokens starting in [@p begin, @p end).
+     * @p begin must be outside of comments and strings, @p lastKind is the kind of token
+     * before @p begin(needed for semicolon insertion) or -1 if there is none.
+     */
+    void lexRange(qint64 begin, qint64 end, int lastKind, Output& output) const;
+
+    /**
+     * Splits contents at newlines, lexes chunks in parallel and fixes up chunks
+     * whose start turned out to be inside a comment or literal.
+     */
+    QVector<Output> lexChunks() const;
+
+    QVector<qint64> chunkBoundaries() const;
+
+    QByteArray m_contents;
+    qint64 m_parallelThreshold;
+};
+
+}
+
+#endif
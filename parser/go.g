@@ -35,18 +35,66 @@
 %input_encoding "UTF-8"
 %input_stream "KDevPG::QByteArrayIterator"
 %lexer_bits_header "QDebug"
+%lexer_declaration_header "functional"
 %parser_bits_header "QDebug"
 %parser_declaration_header "language/duchain/duchain.h"
+%parser_declaration_header "QSet"
+%parser_declaration_header "QHash"
 
 %export_macro "KDEVGOPARSER_EXPORT"
 %export_macro_header "goparserexport.h"
 
 
+%lexerclass (public declaration)
+[:
+    /**
+     * Called with the offset of every character lexer doesn't recognize.
+     * Since parser can pull tokens from lexer on demand, this is the only
+     * way to learn about lexer errors without lexing whole file beforehand.
+     **/
+    std::function<void(qint64)> errorCallback;
+:]
+
 %ast_extra_members
 [:
     KDevelop::DUContext* ducontext;
 :]
 
+%parserclass (public declaration)
+[:
+    /**
+     * When set, bodies of functions and methods are skimmed by brace matching
+     * and no AST nodes are created for them. Used for declarations-only parses
+     * of imported packages, where nobody ever looks at function bodies.
+     **/
+    bool skipFunctionBodies = false;
+
+    /**
+     * Offsets of opening braces of function bodies, which are known to be unchanged since
+     * previous parse of the same document. These bodies are skimmed like with skipFunctionBodies.
+     **/
+    QSet<qint64> reusableBodies;
+
+    /**
+     * Every skimmed body, as index of its closing brace token mapped to index of the opening one.
+     * Closing brace is the last token of function declaration, so this is keyed by its endToken.
+     **/
+    QHash<qint64, qint64> skippedBodies;
+
+    /**
+     * Brings parser to the state of a newly created one, so it can be reused
+     * for another file. Memory pool and token stream still need to be set.
+     **/
+    void resetState();
+
+    /**
+     * Clears flags grammar rules set while parsing if and switch headers.
+     * Needed whenever parsing restarts at another token after a failed attempt,
+     * since a failed rule doesn't restore them.
+     **/
+    void resetGrammarFlags();
+:]
+
 %parserclass (private declaration)
 [:
    struct ParserState {
@@ -56,6 +104,17 @@
     qint64 lparenCount=0;
     bool inIfClause = false;
     bool inSwitchTypeClause = false;
+
+    /**
+     * Skips tokens up to and including the RBRACE matching already consumed LBRACE.
+     * Returns false if file ends before braces are balanced.
+     **/
+    bool skipBlockBody();
+
+    /**
+     * Checks if function body starting at current token has to be skimmed.
+     **/
+    bool skipBody();
 :]
 
 
@@ -253,7 +312,8 @@
 			  lxRETURN(SEMICOLON); } :]	;
 			  
 --output TEST on an unknown symbol so Lexer wouldn't crash
-.	TEST;
+--lxCURR_IDX already points past the unknown symbol here
+.	[: if(errorCallback) errorCallback(lxCURR_IDX - 1); :]	TEST;
  ;
 
 --special rule set for multilined comments
@@ -424,11 +484,14 @@ id=identifier (idList=idList | 0) (type=type (ASSIGN expression=expression ( exp
 
 --Func Declaration-------------------------------------------------------
 
-funcName=identifier signature=signature (body=block | 0)
+--with skipFunctionBodies set or for reusable bodies body is consumed without building any nodes, leaving body empty
+funcName=identifier signature=signature ( ?[: skipBody() :] LBRACE [: if(!skipBlockBody()) return false; :]
+| body=block | 0)
 -> funcDeclaration;;
 
 --Method Declaration-----------------------------------------------------
-methodRecv=methodRecv methodName=identifier signature=signature (body=block | 0)
+methodRecv=methodRecv methodName=identifier signature=signature ( ?[: skipBody() :] LBRACE [: if(!skipBlockBody()) return false; :]
+| body=block | 0)
 ->methodDeclaration;; 
 
 LPAREN ( nameOrType=identifier (star=STAR | 0) (type=identifier | 0) | star=STAR ptype=identifier )  RPAREN
@@ -803,6 +866,50 @@ void Parser::restoreState( Parser::ParserState* state)
 {
 }
 
+void Parser::resetGrammarFlags()
+{
+    lparenCount = 0;
+    inIfClause = false;
+    inSwitchTypeClause = false;
+}
+
+void Parser::resetState()
+{
+    resetGrammarFlags();
+    skipFunctionBodies = false;
+    reusableBodies.clear();
+    skippedBodies.clear();
+    setMemoryPool(0);
+    setTokenStream(0);
+}
+
+bool Parser::skipBody()
+{
+    //declarations of external functions have no body to skip
+    return yytoken == Token_LBRACE && (skipFunctionBodies
+        || (!reusableBodies.isEmpty() && reusableBodies.contains(tokenStream->at(tokenStream->index() - 1).begin)));
+}
+
+bool Parser::skipBlockBody()
+{
+    //LBRACE has already been consumed
+    qint64 lbrace = tokenStream->index() - 2;
+    qint64 depth = 1;
+    while(yytoken != Token_EOF)
+    {
+        if(yytoken == Token_LBRACE)
+            depth++;
+        else if(yytoken == Token_RBRACE && --depth == 0)
+        {
+            skippedBodies.insert(tokenStream->index() - 1, lbrace);
+            yylex();
+            return true;
+        }
+        yylex();
+    }
+    return false;
+}
+
 }
 
 :]
\ No newline at end of file
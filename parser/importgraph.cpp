@@ -0,0 +1,109 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "importgraph.h"
+#include "packagecache.h"
+
+#include <QQueue>
+
+namespace go
+{
+
+ImportGraph ImportGraph::build(const QString& rootDirectory, const QStringList& rootImports, const Resolver& resolver)
+{
+    ImportGraph graph;
+    graph.m_root = rootDirectory;
+    QHash<QString, QString> resolved;
+    QQueue<QString> queue;
+    queue.enqueue(rootDirectory);
+    while(!queue.isEmpty())
+    {
+        QString directory = queue.dequeue();
+        if(graph.m_packages.contains(directory))
+            continue;
+        PackageCache::Package cached = PackageCache::package(directory);
+        Package& package = graph.m_packages[directory];
+        package.files = cached.buildFiles;
+        package.level = -1;
+        QStringList imports = cached.imports;
+        if(directory == rootDirectory)
+            imports += rootImports;
+        for(const QString& import : imports)
+        {
+            //cgo pseudo package
+            if(import == "C")
+                continue;
+            auto iter = resolved.constFind(import);
+            if(iter == resolved.constEnd())
+                iter = resolved.insert(import, resolver(import));
+            const QString& dependency = iter.value();
+            if(dependency.isEmpty() || dependency == directory || package.dependencies.contains(dependency))
+                continue;
+            package.dependencies.append(dependency);
+            if(!graph.m_packages.contains(dependency))
+                queue.enqueue(dependency);
+        }
+    }
+    QSet<QString> visiting;
+    for(auto iter = graph.m_packages.constBegin(); iter != graph.m_packages.constEnd(); ++iter)
+        graph.computeLevel(iter.key(), visiting);
+    return graph;
+}
+
+int ImportGraph::computeLevel(const QString& directory, QSet<QString>& visiting)
+{
+    Package& package = m_packages[directory];
+    if(package.level != -1)
+        return package.level;
+    //Go doesn't allow import cycles, if there is one anyway, it is broken here
+    if(visiting.contains(directory))
+        return -1;
+    visiting.insert(directory);
+    int level = 0;
+    for(const QString& dependency : package.dependencies)
+        level = qMax(level, computeLevel(dependency, visiting) + 1);
+    visiting.remove(directory);
+    package.level = level;
+    return level;
+}
+
+QString ImportGraph::root() const
+{
+    return m_root;
+}
+
+const QHash<QString, ImportGraph::Package>& ImportGraph::packages() const
+{
+    return m_packages;
+}
+
+QList<QStringList> ImportGraph::levels() const
+{
+    QList<QStringList> levels;
+    for(auto iter = m_packages.constBegin(); iter != m_packages.constEnd(); ++iter)
+    {
+        while(levels.size() <= iter->level)
+            levels.append(QStringList());
+        levels[iter->level].append(iter.key());
+    }
+    for(QStringList& level : levels)
+        level.sort();
+    return levels;
+}
+
+}
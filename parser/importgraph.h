@@ -0,0 +1,80 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGIMPORTGRAPH_H
+#define GOLANGIMPORTGRAPH_H
+
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+#include <functional>
+
+#include "goparserexport.h"
+
+namespace go
+{
+
+/**
+ * Graph of packages reachable from a package, built from imports listed in file preambles,
+ * so packages can be parsed bottom up: every package after all packages it imports.
+ */
+class KDEVGOPARSER_EXPORT ImportGraph
+{
+public:
+    /**
+     * Maps import path to package directory, returns an empty string if import can't be resolved.
+     */
+    typedef std::function<QString(const QString&)> Resolver;
+
+    struct Package
+    {
+        //build files of package
+        QStringList files;
+        //directories of imported packages
+        QStringList dependencies;
+        //0 for packages that import nothing, otherwise one more than the highest level of dependencies
+        int level;
+    };
+
+    /**
+     * Builds graph of all packages imported by package in @p rootDirectory, directly or not.
+     * @p rootImports are added to imports of root package, for files not saved yet.
+     */
+    static ImportGraph build(const QString& rootDirectory, const QStringList& rootImports, const Resolver& resolver);
+
+    QString root() const;
+
+    const QHash<QString, Package>& packages() const;
+
+    /**
+     * Returns directories of packages grouped by level. Packages of the same level don't import
+     * each other, so they can be parsed in parallel. Root package has the highest level.
+     */
+    QList<QStringList> levels() const;
+
+private:
+    int computeLevel(const QString& directory, QSet<QString>& visiting);
+
+    QString m_root;
+    QHash<QString, Package> m_packages;
+};
+
+}
+
+#endif
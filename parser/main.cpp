@@ -21,12 +21,161 @@
 
 #include "parsesession.h"
 
+#include <QAtomicInteger>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+
+/**
+ * Results of batch parse, shared by all the jobs.
+ **/
+struct BatchStatistics
+{
+    QMutex mutex;
+    QVector<qint64> parseTimes; //nanoseconds
+    QStringList failures;
+    QAtomicInteger<qint64> bytes{0};
+    QAtomicInteger<qint64> tokens{0};
+    QAtomicInteger<qint64> poolsInUse{0};
+    QAtomicInteger<qint64> peakPools{0};
+};
+
+class ParseFileJob : public QRunnable
+{
+public:
+    ParseFileJob(const QString& path, ParseSession::LexerBackend backend, BatchStatistics* statistics)
+        : m_path(path), m_backend(backend), m_statistics(statistics)
+    {
+    }
+
+    virtual void run() override
+    {
+        QFile file(m_path);
+        if(!file.open(QIODevice::ReadOnly))
+        {
+            QMutexLocker lock(&m_statistics->mutex);
+            m_statistics->failures.append(m_path + " (can't read)");
+            return;
+        }
+        QByteArray code = file.readAll();
+        m_statistics->bytes.fetchAndAddRelaxed(code.size());
+
+        qint64 poolBytes = 0;
+        QElapsedTimer timer;
+        timer.start();
+        {
+            ParseSession session(code, 1);
+            session.setLexerBackend(m_backend);
+            bool result = session.startParsing();
+            qint64 elapsed = timer.nsecsElapsed();
+
+            m_statistics->tokens.fetchAndAddRelaxed(getLexer(session)->size());
+            poolBytes = session.memoryUsage();
+            qint64 inUse = m_statistics->poolsInUse.fetchAndAddRelaxed(poolBytes) + poolBytes;
+            qint64 peak = m_statistics->peakPools.load();
+            while(inUse > peak && !m_statistics->peakPools.testAndSetRelaxed(peak, inUse))
+                peak = m_statistics->peakPools.load();
+
+            QMutexLocker lock(&m_statistics->mutex);
+            m_statistics->parseTimes.append(elapsed);
+            if(!result)
+                m_statistics->failures.append(m_path);
+        }
+        m_statistics->poolsInUse.fetchAndAddRelaxed(-poolBytes);
+    }
+
+private:
+    QString m_path;
+    ParseSession::LexerBackend m_backend;
+    BatchStatistics* m_statistics;
+};
+
+double percentile(const QVector<qint64>& sorted, double fraction)
+{
+    if(sorted.isEmpty())
+        return 0;
+    int index = qMin<int>(sorted.size() - 1, fraction * sorted.size());
+    return sorted[index] / 1e6;
+}
+
+/**
+ * Parses every .go file under @p directory on @p threads threads and prints throughput statistics
+ * and files which failed to parse. Returns 3 if there were such files.
+ **/
+int parseDirectory(const QString& directory, int threads, ParseSession::LexerBackend backend)
+{
+    BatchStatistics statistics;
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    QElapsedTimer timer;
+    timer.start();
+    QDirIterator iterator(directory, QStringList("*.go"), QDir::Files, QDirIterator::Subdirectories);
+    while(iterator.hasNext())
+        pool.start(new ParseFileJob(iterator.next(), backend, &statistics));
+    pool.waitForDone();
+    double seconds = qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9;
+
+    std::sort(statistics.parseTimes.begin(), statistics.parseTimes.end());
+    std::sort(statistics.failures.begin(), statistics.failures.end());
+    int files = statistics.parseTimes.size();
+    printf("files:       %d on %d threads in %.3f s\n", files, threads, seconds);
+    printf("files/s:     %.1f\n", files / seconds);
+    printf("MB/s:        %.2f\n", statistics.bytes.load() / seconds / (1024 * 1024));
+    printf("tokens/s:    %.0f\n", statistics.tokens.load() / seconds);
+    printf("p50 parse:   %.3f ms\n", percentile(statistics.parseTimes, 0.5));
+    printf("p99 parse:   %.3f ms\n", percentile(statistics.parseTimes, 0.99));
+    printf("peak pools:  %.2f MB\n", statistics.peakPools.load() / (1024.0 * 1024));
+    printf("failed:      %d\n", statistics.failures.size());
+    for(const QString& failure : statistics.failures)
+        printf("    %s\n", qPrintable(failure));
+    return statistics.failures.isEmpty() ? 0 : 3;
+}
+
+int usage()
+{
+    fprintf(stderr, "usage: go_parser file.go\n"
+                    "       go_parser [-j threads] [--generated-lexer] directory\n");
+    return 2;
+}
+
+}
+
 int main(int argc, char** argv)
 {
     if(argc < 2)
-	return 2;
-    qDebug() << argv[1];
-    QFile file(argv[1]);
+	return usage();
+
+    int threads = QThread::idealThreadCount();
+    ParseSession::LexerBackend backend = ParseSession::HandWrittenLexer;
+    QString path;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threads = qMax(1, atoi(argv[++i]));
+        else if(strcmp(argv[i], "--generated-lexer") == 0)
+            backend = ParseSession::GeneratedLexer;
+        else if(path.isEmpty())
+            path = QString::fromLocal8Bit(argv[i]);
+        else
+            return usage();
+    }
+    if(QFileInfo(path).isDir())
+        return parseDirectory(path, threads, backend);
+
+    qDebug() << path;
+    QFile file(path);
     if(! file.open(QIODevice::ReadOnly | QIODevice::Text))
     {
 	return 1;
@@ -0,0 +1,405 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "modulegraph.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QRegExp>
+#include <QStringList>
+
+#include "packagecache.h"
+
+namespace go
+{
+
+namespace
+{
+
+struct CachedWorkspaceFile
+{
+    QString file;
+    qint64 checked;
+};
+
+struct CachedGraph
+{
+    std::shared_ptr<const ModuleGraph> graph;
+    qint64 checked;
+};
+
+//only guarded by mutex, files are stat'ed and read without holding it
+struct GraphCache
+{
+    QMutex mutex;
+    //directory -> go.work or go.mod file which applies to it, or empty string
+    QHash<QString, CachedWorkspaceFile> workspaceFiles;
+    //go.work or go.mod file -> graph read from it
+    QHash<QString, CachedGraph> graphs;
+    QElapsedTimer clock;
+
+    GraphCache()
+    {
+        clock.start();
+    }
+};
+
+Q_GLOBAL_STATIC(GraphCache, graphCache)
+
+/**
+ * Splits line of go.mod or go.work into words, dropping comments and quotes.
+ */
+QStringList splitLine(const QString& line)
+{
+    QStringList words;
+    int i = 0;
+    while(i < line.size())
+    {
+        if(line[i].isSpace())
+        {
+            i++;
+            continue;
+        }
+        if(line.midRef(i, 2) == QLatin1String("//"))
+            break;
+        if(line[i] == '"' || line[i] == '`')
+        {
+            int end = line.indexOf(line[i], i + 1);
+            if(end == -1)
+                end = line.size();
+            words.append(line.mid(i + 1, end - i - 1));
+            i = end + 1;
+            continue;
+        }
+        int start = i;
+        while(i < line.size() && !line[i].isSpace() && line.midRef(i, 2) != QLatin1String("//"))
+            i++;
+        words.append(line.mid(start, i - start));
+    }
+    return words;
+}
+
+/**
+ * Reads directives of go.mod or go.work file. Blocks like require ( ... ) are expanded,
+ * so every directive comes with its verb first.
+ */
+QList<QStringList> readDirectives(const QString& file)
+{
+    QList<QStringList> directives;
+    QFile f(file);
+    if(!f.open(QIODevice::ReadOnly))
+        return directives;
+    QString block;
+    for(const QByteArray& line : f.readAll().split('\n'))
+    {
+        QStringList words = splitLine(QString::fromUtf8(line));
+        if(words.isEmpty())
+            continue;
+        if(!block.isEmpty())
+        {
+            if(words.first() == ")")
+                block.clear();
+            else
+                directives.append(QStringList(block) + words);
+        }
+        else if(words.size() == 2 && words[1] == "(")
+            block = words.first();
+        else
+            directives.append(words);
+    }
+    return directives;
+}
+
+bool isLocalPath(const QString& path)
+{
+    return path == "." || path == ".." || path.startsWith("./") || path.startsWith("../") || QDir::isAbsolutePath(path);
+}
+
+}
+
+std::shared_ptr<const ModuleGraph> ModuleGraph::forDirectory(const QString& directory)
+{
+    GraphCache* cache = graphCache;
+    qint64 interval = PackageCache::revalidationInterval();
+    qint64 now;
+    QString file;
+    bool known = false;
+    {
+        QMutexLocker lock(&cache->mutex);
+        now = cache->clock.elapsed();
+        auto found = cache->workspaceFiles.constFind(directory);
+        if(found != cache->workspaceFiles.constEnd() && now - found->checked < interval)
+        {
+            file = found->file;
+            known = true;
+        }
+    }
+    //module files may have been created or deleted since
+    if(!known)
+    {
+        file = findWorkspaceFile(directory);
+        QMutexLocker lock(&cache->mutex);
+        cache->workspaceFiles.insert(directory, CachedWorkspaceFile{file, now});
+    }
+    if(file.isEmpty())
+        return std::shared_ptr<const ModuleGraph>();
+
+    std::shared_ptr<const ModuleGraph> graph;
+    {
+        QMutexLocker lock(&cache->mutex);
+        auto found = cache->graphs.constFind(file);
+        if(found != cache->graphs.constEnd())
+        {
+            if(now - found->checked < interval)
+                return found->graph;
+            graph = found->graph;
+        }
+    }
+    //threads revalidating the same graph at once only do the same work twice
+    if(graph && graph->isUpToDate())
+    {
+        QMutexLocker lock(&cache->mutex);
+        auto found = cache->graphs.find(file);
+        if(found != cache->graphs.end() && found->graph == graph)
+            found->checked = now;
+        return graph;
+    }
+    std::shared_ptr<ModuleGraph> loaded = std::make_shared<ModuleGraph>();
+    bool valid = loaded->load(file);
+    QMutexLocker lock(&cache->mutex);
+    if(!valid)
+    {
+        cache->graphs.remove(file);
+        return std::shared_ptr<const ModuleGraph>();
+    }
+    cache->graphs.insert(file, CachedGraph{loaded, now});
+    return loaded;
+}
+
+QString ModuleGraph::findWorkspaceFile(const QString& directory)
+{
+    //the nearest go.mod is the main module, unless there is a go.work above it
+    QString file;
+    QDir dir(directory);
+    do
+    {
+        if(dir.exists("go.work"))
+            return dir.filePath("go.work");
+        if(file.isEmpty() && dir.exists("go.mod"))
+            file = dir.filePath("go.mod");
+    }
+    while(dir.cdUp());
+    return file;
+}
+
+void ModuleGraph::clearCache()
+{
+    GraphCache* cache = graphCache;
+    QMutexLocker lock(&cache->mutex);
+    cache->workspaceFiles.clear();
+    cache->graphs.clear();
+}
+
+QString ModuleGraph::root() const
+{
+    return m_root;
+}
+
+QString ModuleGraph::packageDirectory(const QString& importPath) const
+{
+    //the longest module path which is a prefix of import path owns the package
+    QString module = importPath;
+    while(!module.isEmpty())
+    {
+        QString rest = importPath.mid(module.size());
+        auto mainModule = m_mainModules.constFind(module);
+        if(mainModule != m_mainModules.constEnd())
+            return *mainModule + rest;
+        bool known = m_versions.contains(module) || m_localReplacements.contains(module) || m_moduleReplacements.contains(module);
+        if(known && m_vendor)
+            return m_root + "/vendor/" + importPath;
+        auto local = m_localReplacements.constFind(module);
+        if(local != m_localReplacements.constEnd())
+            return *local + rest;
+        auto replacement = m_moduleReplacements.constFind(module);
+        if(replacement != m_moduleReplacements.constEnd())
+            return moduleCache() + "/" + escapePath(replacement->first) + "@" + escapePath(replacement->second) + rest;
+        auto version = m_versions.constFind(module);
+        if(version != m_versions.constEnd())
+            return moduleCache() + "/" + escapePath(module) + "@" + escapePath(*version) + rest;
+        int slash = module.lastIndexOf('/');
+        module = slash == -1 ? QString() : module.left(slash);
+    }
+    return QString();
+}
+
+QString ModuleGraph::moduleCache()
+{
+    QString cache = QString::fromLocal8Bit(qgetenv("GOMODCACHE"));
+    if(!cache.isEmpty())
+        return QDir::cleanPath(cache);
+    QString gopath = QString::fromLocal8Bit(qgetenv("GOPATH")).section(QDir::listSeparator(), 0, 0);
+    if(gopath.isEmpty())
+        gopath = QDir::homePath() + "/go";
+    return QDir::cleanPath(gopath + "/pkg/mod");
+}
+
+QString ModuleGraph::escapePath(const QString& path)
+{
+    QString escaped;
+    escaped.reserve(path.size());
+    for(QChar c : path)
+    {
+        if(c.isUpper())
+        {
+            escaped.append('!');
+            escaped.append(c.toLower());
+        }
+        else
+            escaped.append(c);
+    }
+    return escaped;
+}
+
+bool ModuleGraph::load(const QString& file)
+{
+    QFileInfo info(file);
+    m_root = info.absolutePath();
+    m_files.insert(file, stamp(file));
+    if(info.fileName() != "go.work")
+    {
+        QList<QStringList> replacements;
+        if(!loadModule(file, &replacements))
+            return false;
+        for(const QStringList& replacement : replacements)
+            addReplacement(replacement);
+        //vendor directory is only used for single module builds
+        m_vendor = QFile::exists(m_root + "/vendor/modules.txt");
+        m_files.insert(m_root + "/vendor/modules.txt", stamp(m_root + "/vendor/modules.txt"));
+        return true;
+    }
+
+    QList<QStringList> workspaceReplacements;
+    QList<QStringList> moduleReplacements;
+    for(const QStringList& directive : readDirectives(file))
+    {
+        if(directive.first() == "use" && directive.size() >= 2)
+            loadModule(QDir::cleanPath(QDir(m_root).filePath(directive[1]) + "/go.mod"), &moduleReplacements);
+        else if(directive.first() == "replace")
+            workspaceReplacements.append(directive);
+    }
+    //replacements of go.work override those of modules
+    for(const QStringList& replacement : moduleReplacements + workspaceReplacements)
+        addReplacement(replacement);
+    return true;
+}
+
+bool ModuleGraph::loadModule(const QString& file, QList<QStringList>* replacements)
+{
+    m_files.insert(file, stamp(file));
+    if(!QFile::exists(file))
+        return false;
+    QString directory = QFileInfo(file).absolutePath();
+    for(QStringList directive : readDirectives(file))
+    {
+        if(directive.first() == "module" && directive.size() >= 2)
+            m_mainModules.insert(directive[1], directory);
+        else if(directive.first() == "require" && directive.size() >= 3)
+        {
+            //when several modules require the same one, the highest version is used
+            QString& version = m_versions[directive[1]];
+            if(version.isEmpty() || versionLess(version, directive[2]))
+                version = directive[2];
+        }
+        else if(directive.first() == "replace")
+        {
+            //local paths are relative to file they are written in
+            int arrow = directive.indexOf("=>");
+            if(arrow != -1 && arrow + 1 < directive.size() && isLocalPath(directive[arrow + 1]))
+                directive[arrow + 1] = QDir::cleanPath(QDir(directory).filePath(directive[arrow + 1]));
+            replacements->append(directive);
+        }
+    }
+    return true;
+}
+
+void ModuleGraph::addReplacement(const QStringList& directive)
+{
+    //replace old [version] => new [version]
+    int arrow = directive.indexOf("=>");
+    if(arrow < 2 || arrow + 1 >= directive.size())
+        return;
+    const QString& module = directive[1];
+    const QString& target = directive[arrow + 1];
+    if(isLocalPath(target))
+    {
+        m_localReplacements.insert(module, target);
+        m_moduleReplacements.remove(module);
+    }
+    else if(arrow + 2 < directive.size())
+    {
+        m_moduleReplacements.insert(module, qMakePair(target, directive[arrow + 2]));
+        m_localReplacements.remove(module);
+    }
+}
+
+bool ModuleGraph::isUpToDate() const
+{
+    for(auto iter = m_files.constBegin(); iter != m_files.constEnd(); ++iter)
+    {
+        if(stamp(iter.key()) != iter.value())
+            return false;
+    }
+    return true;
+}
+
+ModuleGraph::FileStamp ModuleGraph::stamp(const QString& file)
+{
+    QFileInfo info(file);
+    if(!info.exists())
+        return qMakePair(qint64(-1), qint64(-1));
+    return qMakePair(info.lastModified().toMSecsSinceEpoch(), info.size());
+}
+
+bool ModuleGraph::versionLess(const QString& first, const QString& second)
+{
+    //compares numeric parts of versions like v1.2.3, prerelease suffixes are compared as text
+    QStringList firstParts = first.mid(1).split(QRegExp("[.-]"));
+    QStringList secondParts = second.mid(1).split(QRegExp("[.-]"));
+    for(int i = 0; i < qMin(firstParts.size(), secondParts.size()); ++i)
+    {
+        bool firstNumeric, secondNumeric;
+        qint64 firstNumber = firstParts[i].toLongLong(&firstNumeric);
+        qint64 secondNumber = secondParts[i].toLongLong(&secondNumeric);
+        if(firstNumeric && secondNumeric)
+        {
+            if(firstNumber != secondNumber)
+                return firstNumber < secondNumber;
+        }
+        else if(firstParts[i] != secondParts[i])
+            return firstParts[i] < secondParts[i];
+    }
+    //v1.2.3-pre has more parts than v1.2.3, but is lower
+    return firstParts.size() > secondParts.size();
+}
+
+}
@@ -0,0 +1,103 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGMODULEGRAPH_H
+#define GOLANGMODULEGRAPH_H
+
+#include <QHash>
+#include <QPair>
+#include <QString>
+
+#include <memory>
+
+#include "goparserexport.h"
+
+namespace go
+{
+
+/**
+ * Modules of a Go workspace, read from go.work or go.mod with their require and replace directives.
+ * Maps import paths to package directories in main modules, local replacements, vendor directory
+ * or module cache($GOMODCACHE). Only local files are read, nothing is ever downloaded.
+ * Graphs are cached per workspace and reloaded when any of the files they were read from changes.
+ * Like package listings, which module files apply to a directory and whether they changed
+ * is checked again at most once per PackageCache revalidation interval.
+ */
+class KDEVGOPARSER_EXPORT ModuleGraph
+{
+public:
+    /**
+     * Returns graph of workspace containing @p directory, or null if it isn't in module mode.
+     * go.work takes precedence over go.mod, like in go tool.
+     */
+    static std::shared_ptr<const ModuleGraph> forDirectory(const QString& directory);
+
+    /**
+     * Returns directory of package @p importPath, or an empty string if it doesn't belong
+     * to any module of this graph(e.g. standard library packages).
+     */
+    QString packageDirectory(const QString& importPath) const;
+
+    /**
+     * Directory of go.work or go.mod this graph was read from.
+     */
+    QString root() const;
+
+    /**
+     * Module cache directory: $GOMODCACHE, or pkg/mod in the first $GOPATH entry or in ~/go.
+     */
+    static QString moduleCache();
+
+    /**
+     * Escapes module path or version for module cache, where upper case letters are
+     * replaced by '!' followed by the lower case letter.
+     */
+    static QString escapePath(const QString& path);
+
+    static void clearCache();
+
+private:
+    typedef QPair<qint64, qint64> FileStamp; //modification time and size
+
+    /**
+     * Returns go.work or go.mod which applies to @p directory, or an empty string.
+     */
+    static QString findWorkspaceFile(const QString& directory);
+
+    bool load(const QString& file);
+    bool loadModule(const QString& file, QList<QStringList>* replacements);
+    void addReplacement(const QStringList& directive);
+    bool isUpToDate() const;
+    static FileStamp stamp(const QString& file);
+    static bool versionLess(const QString& first, const QString& second);
+
+    QString m_root;
+    bool m_vendor = false;
+    //module path -> directory
+    QHash<QString, QString> m_mainModules;
+    //module path -> required version
+    QHash<QString, QString> m_versions;
+    //module path -> replacement directory or replacement module path and version
+    QHash<QString, QString> m_localReplacements;
+    QHash<QString, QPair<QString, QString>> m_moduleReplacements;
+    QHash<QString, FileStamp> m_files;
+};
+
+}
+
+#endif
@@ -0,0 +1,330 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "packagecache.h"
+#include "preamble.h"
+
+#include <QAtomicInteger>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QReadWriteLock>
+
+namespace go
+{
+
+namespace
+{
+
+struct CachedPackage
+{
+    PackageCache::Package package;
+    qint64 modified;
+    //modification times and sizes of all listed files, preambles are read from
+    QByteArray stamp;
+    qint64 checked;
+    //hash of contents of build files, computed on first request
+    QByteArray contentHash;
+    //stamp and digest of every build file the hash was computed from, so only changed files are read again
+    QHash<QString, QPair<QByteArray, QByteArray>> fileDigests;
+    qint64 hashChecked = 0;
+    //content hash combined with resolved imports, see canonicalDirectory()
+    QByteArray canonicalKey;
+    qint64 keyChecked = 0;
+};
+
+struct PackageCacheData
+{
+    QReadWriteLock lock;
+    QHash<QString, CachedPackage> packages;
+    //directories import paths were resolved to, in order they were seen
+    QHash<QString, QStringList> importDirectories;
+    QAtomicInteger<qint64> interval{PackageCache::DefaultRevalidationInterval};
+    QElapsedTimer clock;
+
+    PackageCacheData()
+    {
+        clock.start();
+    }
+};
+
+Q_GLOBAL_STATIC(PackageCacheData, cacheData)
+
+qint64 modificationTime(const QFileInfo& info)
+{
+    return info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+QByteArray fileStamp(const QString& file)
+{
+    QFileInfo info(file);
+    return QByteArray::number(modificationTime(info)) + ':' + QByteArray::number(info.size()) + ';';
+}
+
+QByteArray filesStamp(const QStringList& files)
+{
+    QByteArray stamp;
+    for(const QString& file : files)
+        stamp += fileStamp(file);
+    return stamp;
+}
+
+/**
+ * Hashes package name and names and digests of build files. Files whose stamp didn't change
+ * since @p digests were computed aren't read again, @p digests are updated for the rest.
+ */
+QByteArray hashFiles(const PackageCache::Package& package, QHash<QString, QPair<QByteArray, QByteArray>>* digests)
+{
+    QHash<QString, QPair<QByteArray, QByteArray>> current;
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(package.name.toUtf8());
+    for(const QString& path : package.buildFiles)
+    {
+        QPair<QByteArray, QByteArray> digest = digests->value(path);
+        QByteArray stamp = fileStamp(path);
+        if(digest.first != stamp || digest.second.isEmpty())
+        {
+            QFile file(path);
+            if(!file.open(QIODevice::ReadOnly))
+                return QByteArray();
+            QCryptographicHash fileHash(QCryptographicHash::Sha1);
+            fileHash.addData(&file);
+            digest = qMakePair(stamp, fileHash.result());
+        }
+        current.insert(path, digest);
+        //names matter as well, they can carry build constraints
+        hash.addData(QFileInfo(path).fileName().toUtf8());
+        hash.addData("\0", 1);
+        hash.addData(digest.second);
+    }
+    *digests = current;
+    return hash.result();
+}
+
+void scanPreambles(PackageCache::Package& package)
+{
+    BuildContext context = BuildContext::current();
+    QHash<QString, int> names;
+    QHash<QString, QStringList> imports;
+    for(const QString& file : package.files)
+    {
+        Preamble preamble = Preamble::read(file);
+        package.packageNames.insert(file, preamble.packageName);
+        if(file.endsWith("_test.go") || preamble.packageName.isEmpty() || !preamble.matches(context, file))
+            continue;
+        package.buildFiles.append(file);
+        imports.insert(file, preamble.imports);
+        names[preamble.packageName]++;
+    }
+    //stray files of other packages are normally excluded by constraints, otherwise go with majority
+    for(auto iter = names.constBegin(); iter != names.constEnd(); ++iter)
+    {
+        if(package.name.isEmpty() || iter.value() > names.value(package.name))
+            package.name = iter.key();
+    }
+    if(names.size() > 1)
+    {
+        QStringList buildFiles;
+        for(const QString& file : package.buildFiles)
+        {
+            if(package.packageNames[file] == package.name)
+                buildFiles.append(file);
+        }
+        package.buildFiles = buildFiles;
+    }
+    for(const QString& file : package.buildFiles)
+    {
+        for(const QString& import : imports[file])
+        {
+            if(!package.imports.contains(import))
+                package.imports.append(import);
+        }
+    }
+}
+
+}
+
+PackageCache::Package PackageCache::package(const QString& directory)
+{
+    PackageCacheData* data = cacheData;
+    qint64 now = data->clock.elapsed();
+    {
+        QReadLocker lock(&data->lock);
+        auto iter = data->packages.constFind(directory);
+        if(iter != data->packages.constEnd())
+        {
+            if(now - iter->checked < data->interval.load())
+                return iter->package;
+            Package package = iter->package;
+            qint64 modified = iter->modified;
+            QByteArray stamp = iter->stamp;
+            lock.unlock();
+            //adding, removing or renaming files changes modification time of directory,
+            //while editing them in place (e.g. their package clause, imports or build constraints) doesn't
+            if(modificationTime(QFileInfo(directory)) == modified && filesStamp(package.files) == stamp)
+            {
+                QWriteLocker writeLock(&data->lock);
+                auto cached = data->packages.find(directory);
+                if(cached != data->packages.end() && cached->stamp == stamp)
+                    cached->checked = now;
+                return package;
+            }
+        }
+    }
+
+    QFileInfo info(directory);
+    CachedPackage cached;
+    cached.modified = modificationTime(info);
+    cached.checked = now;
+    cached.package.exists = info.isDir();
+    if(cached.package.exists)
+    {
+        QDir dir(directory);
+        for(const QString& file : dir.entryList(QStringList("*.go"), QDir::Files | QDir::NoSymLinks))
+            cached.package.files.append(dir.filePath(file));
+        cached.stamp = filesStamp(cached.package.files);
+        scanPreambles(cached.package);
+    }
+    QWriteLocker lock(&data->lock);
+    data->packages.insert(directory, cached);
+    return cached.package;
+}
+
+QString PackageCache::findPackage(const QString& importPath, const QList<QString>& searchPaths)
+{
+    for(const QString& searchPath : searchPaths)
+    {
+        QString directory = QDir::cleanPath(searchPath + "/" + importPath);
+        if(package(directory).exists)
+            return directory;
+    }
+    return QString();
+}
+
+QByteArray PackageCache::contentHash(const QString& directory)
+{
+    Package package = PackageCache::package(directory);
+    if(package.buildFiles.isEmpty())
+        return QByteArray();
+    PackageCacheData* data = cacheData;
+    qint64 now = data->clock.elapsed();
+    QHash<QString, QPair<QByteArray, QByteArray>> digests;
+    {
+        QReadLocker lock(&data->lock);
+        auto iter = data->packages.constFind(directory);
+        if(iter != data->packages.constEnd())
+        {
+            if(!iter->contentHash.isEmpty() && now - iter->hashChecked < data->interval.load())
+                return iter->contentHash;
+            digests = iter->fileDigests;
+        }
+    }
+    //files can be edited in place without touching directory, only those are read again
+    QByteArray hash = hashFiles(package, &digests);
+    QWriteLocker lock(&data->lock);
+    auto iter = data->packages.find(directory);
+    if(iter != data->packages.end() && iter->package.buildFiles == package.buildFiles)
+    {
+        iter->contentHash = hash;
+        iter->fileDigests = digests;
+        iter->hashChecked = now;
+    }
+    return hash;
+}
+
+QByteArray PackageCache::canonicalKey(const QString& directory, const ImportResolver& resolveImports)
+{
+    PackageCacheData* data = cacheData;
+    qint64 now = data->clock.elapsed();
+    {
+        QReadLocker lock(&data->lock);
+        auto iter = data->packages.constFind(directory);
+        if(iter != data->packages.constEnd() && !iter->canonicalKey.isEmpty() && now - iter->keyChecked < data->interval.load())
+            return iter->canonicalKey;
+    }
+    QByteArray hash = contentHash(directory);
+    if(hash.isEmpty())
+        return hash;
+    //the same sources importing different packages declare different things
+    QCryptographicHash digest(QCryptographicHash::Sha1);
+    digest.addData(hash);
+    for(const QString& import : resolveImports(directory))
+    {
+        digest.addData(import.toUtf8());
+        digest.addData("\0", 1);
+    }
+    QByteArray key = digest.result();
+    QWriteLocker lock(&data->lock);
+    auto iter = data->packages.find(directory);
+    if(iter != data->packages.end())
+    {
+        iter->canonicalKey = key;
+        iter->keyChecked = now;
+    }
+    return key;
+}
+
+QString PackageCache::canonicalDirectory(const QString& importPath, const QString& directory, const ImportResolver& resolveImports)
+{
+    PackageCacheData* data = cacheData;
+    QStringList earlier;
+    {
+        QWriteLocker lock(&data->lock);
+        QStringList& seen = data->importDirectories[importPath];
+        if(!seen.contains(directory))
+            seen.append(directory);
+        earlier = seen.mid(0, seen.indexOf(directory));
+    }
+    //nothing to share with until another copy of the same import shows up, so nothing is hashed
+    if(earlier.isEmpty())
+        return directory;
+    QByteArray own = canonicalKey(directory, resolveImports);
+    if(own.isEmpty())
+        return directory;
+    //copies seen first win, unless they have been changed or removed since
+    for(const QString& copy : earlier)
+    {
+        if(canonicalKey(copy, resolveImports) == own)
+            return copy;
+    }
+    return directory;
+}
+
+void PackageCache::setRevalidationInterval(qint64 msecs)
+{
+    cacheData->interval.store(msecs);
+}
+
+qint64 PackageCache::revalidationInterval()
+{
+    return cacheData->interval.load();
+}
+
+void PackageCache::clear()
+{
+    PackageCacheData* data = cacheData;
+    QWriteLocker lock(&data->lock);
+    data->packages.clear();
+    data->importDirectories.clear();
+}
+
+}
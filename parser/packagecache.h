@@ -0,0 +1,109 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGPACKAGECACHE_H
+#define GOLANGPACKAGECACHE_H
+
+#include <QHash>
+#include <QStringList>
+
+#include <functional>
+
+#include "goparserexport.h"
+
+namespace go
+{
+
+/**
+ * Caches listings of package directories shared by all parse sessions, so resolving imports
+ * like "fmt" doesn't stat and read the same directory for every file that imports it.
+ * Missing directories are cached as well, since every import is looked up in several search paths.
+ * Cached directory is revalidated by modification times of the directory and its files, at most once per revalidation interval.
+ */
+class KDEVGOPARSER_EXPORT PackageCache
+{
+public:
+    struct Package
+    {
+        bool exists;
+        QStringList files;
+        //files that are part of build in current BuildContext, test files excluded
+        QStringList buildFiles;
+        //package name declared by build files
+        QString name;
+        //package name declared by each file
+        QHash<QString, QString> packageNames;
+        //import paths used by build files
+        QStringList imports;
+    };
+
+    /**
+     * Returns whether @p directory exists and absolute paths of .go files in it.
+     * Preambles of files are scanned to tell which of them are part of build, they are scanned again
+     * whenever any of the files is changed, added or removed.
+     */
+    static Package package(const QString& directory);
+
+    /**
+     * Looks for directory of @p importPath in @p searchPaths.
+     * Returns the first one that exists, or an empty path if there is no such directory.
+     */
+    static QString findPackage(const QString& importPath, const QList<QString>& searchPaths);
+
+    /**
+     * Returns hash of package name, names and contents of build files of package in @p directory,
+     * or an empty array if there are none. Files are stat'ed again at most once per revalidation interval,
+     * and only files changed since are read again.
+     */
+    static QByteArray contentHash(const QString& directory);
+
+    /**
+     * Returns directories of packages imported by package in given directory, as seen from that directory.
+     */
+    typedef std::function<QStringList(const QString&)> ImportResolver;
+
+    /**
+     * Returns the first directory @p importPath was resolved to with the same content hash as @p directory,
+     * whose imports resolve to the same directories, or @p directory itself.
+     * Vendored and cached copies of a package then all share contexts of a single copy,
+     * unless they are built against different dependencies, e.g. of different modules.
+     * Contents are only hashed once @p importPath was resolved to more than one directory,
+     * and hashes are kept with cached listings.
+     */
+    static QString canonicalDirectory(const QString& importPath, const QString& directory, const ImportResolver& resolveImports);
+
+    /**
+     * Sets how long, in milliseconds, cached listings are trusted without checking modification time.
+     */
+    static void setRevalidationInterval(qint64 msecs);
+    static qint64 revalidationInterval();
+
+    static void clear();
+
+    static const qint64 DefaultRevalidationInterval = 2000;
+
+private:
+    /**
+     * Content hash of @p directory combined with directories its imports resolve to.
+     */
+    static QByteArray canonicalKey(const QString& directory, const ImportResolver& resolveImports);
+};
+
+}
+
+#endif
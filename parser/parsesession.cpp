@@ -22,6 +22,12 @@
 #include "parser/goparser.h"
 #include "parser/goast.h"
 #include "parser/gotokentext.h"
+#include "poolrecycler.h"
+#include "tokenpositions.h"
+#include "fastlexer.h"
+#include "packagecache.h"
+#include "modulegraph.h"
+#include "importgraph.h"
 
 #include <language/duchain/duchainlock.h>
 #include <interfaces/icore.h>
@@ -29,19 +35,54 @@
 #include <interfaces/ilanguagecontroller.h>
 #include <QProcess>
 #include <QUrl>
+#include <QCache>
+#include <QSet>
+#include <QMutex>
+
+#include <algorithm>
+#include <cctype>
 
 #include "kdev-pg-memory-pool.h"
 #include "kdev-pg-token-stream.h"
 
 using namespace KDevelop;
 
-ParseSession::ParseSession(const QByteArray& contents, int priority, bool appendWithNewline) : m_pool(new KDevPG::MemoryPool()),
-						      m_parser(new go::Parser()),
+namespace
+{
+
+/**
+ * Contents of document, which DUChain was last built from, and its function bodies.
+ **/
+struct BodySnapshot
+{
+    QByteArray contents;
+    QVector<ParseSession::FunctionSpan> functions;
+};
+
+struct BodySnapshots
+{
+    QMutex mutex;
+    //cost is size of contents, so this keeps about 32MB of text
+    QCache<IndexedString, BodySnapshot> snapshots{32 * 1024 * 1024};
+};
+
+Q_GLOBAL_STATIC(BodySnapshots, bodySnapshots)
+
+}
+
+ParseSession::ParseSession(const QByteArray& contents, int priority, bool appendWithNewline) : m_pool(go::PoolRecycler::acquirePool()),
+						      m_parser(go::PoolRecycler::acquireParser()),
 						      //converting to and back from QString eliminates all the \000 at the end of contents
 						      //m_contents(QString(contents).toUtf8()),
 						      m_contents(contents),
 						      m_priority(priority),
-						      m_features(TopDUContext::AllDeclarationsAndContexts)
+						      m_features(TopDUContext::AllDeclarationsAndContexts),
+						      m_tokenizationMode(Streaming),
+						      m_lexerBackend(GeneratedLexer),
+						      m_lexerError(false),
+						      m_recovered(false),
+						      m_incremental(false),
+						      m_expressionHits(0)
 {
     //appending with new line helps lexer to set correct semicolons
     //(lexer sets semicolons on newlines if some conditions are met because
@@ -49,19 +90,21 @@ ParseSession::ParseSession(const QByteArray& contents, int priority, bool append
     // See more in Go Language Specification http://golang.org/ref/spec#Semicolons
     if(appendWithNewline)
 	m_contents.append("\n");
-    KDevPG::QByteArrayIterator iter(m_contents); 
-    m_lexer = new go::Lexer(iter);
+    //lexer is created by prepareTokens(), once lexer backend is known
+    m_lexer = 0;
+    m_positions = 0;
     m_parser->setMemoryPool(m_pool);
-    m_parser->setTokenStream(m_lexer);
     forExport=false;
+    m_canonicalImports = 0;
     
 }
 
 ParseSession::~ParseSession()
 {
-    delete m_pool;
-    delete m_parser;
-    //delete m_iter;
+    go::PoolRecycler::releaseParser(m_parser);
+    go::PoolRecycler::releasePool(m_pool);
+    delete m_positions;
+    delete m_lexer;
 }
 
 
@@ -73,39 +116,496 @@ KDevelop::IndexedString ParseSession::languageString()
 
 bool ParseSession::startParsing()
 {
-    if(!lex())
-	return false;
-    
-    return m_parser->parseStart(&m_ast);
+    if(!m_document.isEmpty())
+    {
+        //whatever happens with this parse, DUChain won't match the snapshot anymore
+        BodySnapshot* previous;
+        {
+            QMutexLocker lock(&bodySnapshots->mutex);
+            previous = bodySnapshots->snapshots.take(m_document);
+        }
+        if(previous && m_incremental && !m_parser->skipFunctionBodies)
+            findReusableBodies(previous->contents, previous->functions);
+        delete previous;
+    }
+    bool result = prepareTokens() && m_parser->parseStart(&m_ast);
+    //in streaming mode lexer errors are only reported while parser pulls tokens
+    result = result && !m_lexerError;
+    if(!result)
+        m_recovered = recover();
+    return result;
 }
 
-bool ParseSession::lex()
+void ParseSession::createLexer(const QByteArray& input)
+{
+    delete m_positions;
+    delete m_lexer;
+    KDevPG::QByteArrayIterator iter(input);
+    m_lexer = new go::Lexer(iter);
+    m_lexer->errorCallback = [this](qint64 offset) { reportLexerError(offset); };
+    m_positions = new go::TokenPositions(m_contents, m_lexer);
+    m_parser->setTokenStream(m_lexer);
+}
+
+bool ParseSession::prepareTokens()
 {
-    KDevPG::Token token;
-    int kind = go::Parser::Token_EOF;
-    while((kind = m_lexer->read().kind) != go::Parser::Token_EOF)
+    if(m_lexerBackend == HandWrittenLexer)
     {
-        //qDebug() << go::tokenText(kind);
-	if(kind == go::Parser::Token_TEST)
-	{
-	    qint64 line, column;
-	    m_lexer->locationTable()->positionAt(m_lexer->index(), &line, &column);
-	    qDebug() << "Lexer error at: " << line << " : " << column;
-	    return false;
-	}
+        //tokens go to a lexer over empty input, so if parser reads past EOF
+        //generated lexer won't start lexing contents again
+        static const QByteArray noInput;
+        createLexer(noInput);
+        go::FastLexer(m_contents).tokenize(m_lexer);
+        m_parser->rewind(0);
+        return true;
     }
+    createLexer(m_contents);
+    if(m_tokenizationMode == Prelexed)
+        return lex();
     m_parser->rewind(0);
     return true;
 }
 
+bool ParseSession::lex()
+{
+    while(m_lexer->read().kind != go::Parser::Token_EOF)
+    {
+        if(m_lexerError)
+            return false;
+    }
+    m_parser->rewind(0);
+    return !m_lexerError;
+}
+
+void ParseSession::reportLexerError(qint64 offset)
+{
+    go::TokenPositions::Position position = m_positions->positionAt(offset);
+    qDebug() << "Lexer error at: " << position.line << " : " << position.column;
+    m_lexerError = true;
+}
+
 bool ParseSession::parseExpression(go::ExpressionAst** node)
 {
-    if(!lex())
-	return false;
-    
-    return m_parser->parseExpression(node);
+    if(!prepareTokens())
+        return false;
+
+    bool result = m_parser->parseExpression(node);
+    return result && !m_lexerError;
+}
+
+void ParseSession::setTokenizationMode(ParseSession::TokenizationMode mode)
+{
+    m_tokenizationMode = mode;
+}
+
+ParseSession::TokenizationMode ParseSession::tokenizationMode() const
+{
+    return m_tokenizationMode;
+}
+
+void ParseSession::setLexerBackend(ParseSession::LexerBackend backend)
+{
+    m_lexerBackend = backend;
+}
+
+ParseSession::LexerBackend ParseSession::lexerBackend() const
+{
+    return m_lexerBackend;
+}
+
+bool ParseSession::hasLexerErrors() const
+{
+    return m_lexerError;
+}
+
+qint64 ParseSession::memoryUsage() const
+{
+    return go::PoolRecycler::poolSize(m_pool);
+}
+
+void ParseSession::setIncrementalParsing(bool enabled)
+{
+    m_incremental = enabled;
+}
+
+void ParseSession::findReusableBodies(const QByteArray& previousContents, const QVector<FunctionSpan>& functions)
+{
+    //everything between common prefix and common suffix is considered changed
+    qint64 limit = qMin(previousContents.size(), m_contents.size());
+    const char* previous = previousContents.constData();
+    const char* current = m_contents.constData();
+    qint64 prefix = std::mismatch(previous, previous + limit, current).first - previous;
+    qint64 suffix = 0;
+    const char* previousEnd = previous + previousContents.size();
+    const char* currentEnd = current + m_contents.size();
+    while(suffix < limit - prefix && previousEnd[-suffix - 1] == currentEnd[-suffix - 1])
+        suffix++;
+    qint64 changedEnd = previousContents.size() - suffix;
+    QByteArray removed = previousContents.mid(prefix, changedEnd - prefix);
+    QByteArray inserted = m_contents.mid(prefix, m_contents.size() - suffix - prefix);
+    //braces are counted without regard to strings and comments, which only gives up reuse more often
+    auto balanced = [](const QByteArray& text) {
+        int depth = 0;
+        for(char c : text)
+        {
+            if(c == '{')
+                depth++;
+            else if(c == '}' && --depth < 0)
+                return false;
+        }
+        return depth == 0;
+    };
+    auto blankOrComments = [](const QByteArray& text) {
+        for(int i = 0; i < text.size(); i++)
+        {
+            if(text.mid(i, 2) == "//")
+            {
+                //comment has to end inside the change, otherwise it swallows unchanged text
+                i = text.indexOf('\n', i);
+                if(i < 0)
+                    return false;
+            }
+            else if(!std::isspace(static_cast<unsigned char>(text[i])))
+                return false;
+        }
+        return true;
+    };
+    bool bodyEdit = balanced(removed) && balanced(inserted) &&
+        std::any_of(functions.begin(), functions.end(), [prefix, changedEnd](const FunctionSpan& function) {
+            return prefix > function.bodyStart && changedEnd <= function.bodyEnd;
+        });
+    bool layoutEdit = (prefix == 0 || previous[prefix - 1] == '\n') && blankOrComments(removed) && blankOrComments(inserted);
+    if(!bodyEdit && !layoutEdit)
+        return;
+    qint64 shift = m_contents.size() - previousContents.size();
+    //builders find contexts of reused bodies by their previous ranges
+    go::TokenPositions previousPositions(previousContents, 0);
+    auto previousRange = [&previousPositions](const FunctionSpan& function) {
+        go::TokenPositions::Position start = previousPositions.positionAt(function.bodyStart);
+        go::TokenPositions::Position end = previousPositions.positionAt(function.bodyEnd + 1);
+        return KDevelop::RangeInRevision(start.line, start.column, end.line, end.column);
+    };
+    for(const FunctionSpan& function : functions)
+    {
+        if(function.bodyEnd < prefix)
+        {
+            m_parser->reusableBodies.insert(function.bodyStart);
+            m_previousBodyRanges.insert(function.bodyStart, previousRange(function));
+        }
+        else if(function.declaration >= changedEnd)
+        {
+            m_parser->reusableBodies.insert(function.bodyStart + shift);
+            m_previousBodyRanges.insert(function.bodyStart + shift, previousRange(function));
+        }
+    }
+}
+
+void ParseSession::rememberFunctionBodies()
+{
+    if(!m_incremental || m_document.isEmpty() || !m_ast || !m_ast->sourceFile || m_recovered)
+        return;
+    BodySnapshot* snapshot = new BodySnapshot;
+    snapshot->contents = m_contents;
+    auto declarations = m_ast->sourceFile->topDeclarationsSequence;
+    if(declarations)
+    {
+        auto iter = declarations->front(), end = iter;
+        do
+        {
+            go::AstNode* function = iter->element->funcDecl;
+            go::BlockAst* body = iter->element->funcDecl ? iter->element->funcDecl->body : 0;
+            if(iter->element->methodDecl)
+            {
+                function = iter->element->methodDecl;
+                body = iter->element->methodDecl->body;
+            }
+            if(body)
+                snapshot->functions.append({m_lexer->at(iter->element->startToken).begin, m_lexer->at(body->startToken).begin,
+                                            m_lexer->at(body->endToken).end});
+            else if(function && m_parser->skippedBodies.contains(function->endToken))
+                snapshot->functions.append({m_lexer->at(iter->element->startToken).begin,
+                                            m_lexer->at(m_parser->skippedBodies.value(function->endToken)).begin,
+                                            m_lexer->at(function->endToken).end});
+            iter = iter->next;
+        }
+        while(iter != end);
+    }
+    QMutexLocker lock(&bodySnapshots->mutex);
+    bodySnapshots->snapshots.insert(m_document, snapshot, snapshot->contents.size());
+}
+
+bool ParseSession::isBodyReused(go::AstNode* function)
+{
+    return !m_parser->skipFunctionBodies && m_parser->skippedBodies.contains(function->endToken);
+}
+
+KDevelop::RangeInRevision ParseSession::reusedBodyRange(go::AstNode* function)
+{
+    go::TokenPositions::Position start = m_positions->start(m_parser->skippedBodies.value(function->endToken));
+    go::TokenPositions::Position end = m_positions->end(function->endToken);
+    return KDevelop::RangeInRevision(start.line, start.column, end.line, end.column);
+}
+
+KDevelop::RangeInRevision ParseSession::previousBodyRange(go::AstNode* function)
+{
+    qint64 offset = m_lexer->at(m_parser->skippedBodies.value(function->endToken)).begin;
+    return m_previousBodyRanges.value(offset, reusedBodyRange(function));
+}
+
+go::BlockAst* ParseSession::parseReusedBody(go::AstNode* function)
+{
+    go::BlockAst* body = 0;
+    restartParserAt(m_parser->skippedBodies.value(function->endToken));
+    if(!m_parser->parseBlock(&body))
+        return 0;
+    return body;
+}
+
+bool ParseSession::isRecovered() const
+{
+    return m_recovered;
+}
+
+QList<KDevelop::RangeInRevision> ParseSession::syntaxErrors()
+{
+    QList<KDevelop::RangeInRevision> ranges;
+    for(const QPair<qint64, qint64>& error : m_syntaxErrors)
+    {
+        go::TokenPositions::Position start = m_positions->start(error.first);
+        go::TokenPositions::Position end = m_positions->end(error.second);
+        ranges.append(KDevelop::RangeInRevision(start.line, start.column, end.line, end.column));
+    }
+    return ranges;
+}
+
+int ParseSession::tokenKind(qint64 index)
+{
+    if(index < 0 || index >= m_lexer->size())
+        return go::Parser::Token_EOF;
+    return m_lexer->at(index).kind;
+}
+
+qint64 ParseSession::currentToken()
+{
+    //parser has already read the token it looks at
+    return m_lexer->index() - 1;
+}
+
+void ParseSession::addSyntaxError(qint64 startToken, qint64 endToken)
+{
+    if(endToken < startToken)
+        endToken = startToken;
+    //don't report inserted semicolon and EOF tokens at the end of skipped range
+    while(endToken > startToken && (tokenKind(endToken) == go::Parser::Token_SEMICOLON || tokenKind(endToken) == go::Parser::Token_EOF))
+        endToken--;
+    m_syntaxErrors.append(qMakePair(startToken, endToken));
+}
+
+qint64 ParseSession::nextTopLevelBoundary(qint64 from)
+{
+    //gofmt puts every top level declaration on a line start,
+    //and we can't rely on braces here since broken code is often unbalanced
+    for(qint64 i = from; i < m_lexer->size(); ++i)
+    {
+        switch(m_lexer->at(i).kind)
+        {
+        case go::Parser::Token_EOF:
+            return i;
+        case go::Parser::Token_FUNC:
+        case go::Parser::Token_TYPE:
+        case go::Parser::Token_VAR:
+        case go::Parser::Token_CONST:
+        case go::Parser::Token_IMPORT:
+            if(m_positions->start(i).column == 0)
+                return i;
+            break;
+        default:
+            break;
+        }
+    }
+    return m_lexer->size() - 1;
+}
+
+bool ParseSession::recover()
+{
+    m_syntaxErrors.clear();
+    //parser stops pulling tokens at the error, so get the rest of the file
+    if(m_lexer->size() == 0 || m_lexer->at(m_lexer->size() - 1).kind != go::Parser::Token_EOF)
+    {
+        m_lexer->rewind(m_lexer->size());
+        while(m_lexer->read().kind != go::Parser::Token_EOF);
+    }
+
+    restartParserAt(0);
+    go::PackageClauseAst* packageClause = 0;
+    //without package clause builders have nothing to put declarations into
+    if(!m_parser->parsePackageClause(&packageClause) || tokenKind(currentToken()) != go::Parser::Token_SEMICOLON)
+        return false;
+
+    go::StartAst* start = m_parser->create<go::StartAst>();
+    go::SourceFileAst* sourceFile = m_parser->create<go::SourceFileAst>();
+    start->sourceFile = sourceFile;
+    sourceFile->packageClause = packageClause;
+
+    qint64 position = currentToken() + 1;
+    while(tokenKind(position) != go::Parser::Token_EOF)
+    {
+        int kind = tokenKind(position);
+        if(kind == go::Parser::Token_SEMICOLON)
+        {
+            position++;
+            continue;
+        }
+        restartParserAt(position);
+        bool parsed = false;
+        if(kind == go::Parser::Token_IMPORT)
+        {
+            go::ImportDeclAst* importDecl = 0;
+            parsed = m_parser->parseImportDecl(&importDecl);
+            if(parsed && currentToken() > position && (tokenKind(currentToken()) == go::Parser::Token_SEMICOLON || tokenKind(currentToken()) == go::Parser::Token_EOF))
+                sourceFile->importDeclSequence = KDevPG::snoc(sourceFile->importDeclSequence, importDecl, m_pool);
+            else
+                parsed = false;
+        }
+        else
+        {
+            go::TopLevelDeclarationAst* declaration = 0;
+            parsed = m_parser->parseTopLevelDeclaration(&declaration);
+            if(parsed && currentToken() > position && (tokenKind(currentToken()) == go::Parser::Token_SEMICOLON || tokenKind(currentToken()) == go::Parser::Token_EOF))
+                sourceFile->topDeclarationsSequence = KDevPG::snoc(sourceFile->topDeclarationsSequence, declaration, m_pool);
+            else
+                parsed = false;
+        }
+        if(parsed)
+        {
+            position = currentToken() + 1;
+            continue;
+        }
+
+        qint64 boundary = nextTopLevelBoundary(position + 1);
+        if(kind == go::Parser::Token_FUNC)
+        {
+            go::TopLevelDeclarationAst* function = recoverFunction(position, boundary);
+            if(function)
+                sourceFile->topDeclarationsSequence = KDevPG::snoc(sourceFile->topDeclarationsSequence, function, m_pool);
+            else
+                addSyntaxError(position, boundary - 1);
+        }
+        else
+            addSyntaxError(position, boundary - 1);
+        position = boundary;
+    }
+    sourceFile->startToken = 0;
+    sourceFile->endToken = qMax<qint64>(0, position - 1);
+    start->startToken = sourceFile->startToken;
+    start->endToken = sourceFile->endToken;
+    m_ast = start;
+    return true;
+}
+
+void ParseSession::restartParserAt(qint64 token)
+{
+    m_parser->resetGrammarFlags();
+    m_parser->rewind(token);
+}
+
+go::TopLevelDeclarationAst* ParseSession::recoverFunction(qint64 start, qint64 limit)
+{
+    go::TopLevelDeclarationAst* declaration = m_parser->create<go::TopLevelDeclarationAst>();
+    go::AstNode* function = 0;
+    go::BlockAst** body = 0;
+    restartParserAt(start + 1);
+    if(tokenKind(start + 1) == go::Parser::Token_LPAREN)
+    {
+        go::MethodDeclarationAst* method = m_parser->create<go::MethodDeclarationAst>();
+        if(!m_parser->parseMethodRecv(&method->methodRecv) || !m_parser->parseIdentifier(&method->methodName)
+            || !m_parser->parseSignature(&method->signature))
+            return 0;
+        declaration->methodDecl = method;
+        function = method;
+        body = &method->body;
+    }
+    else
+    {
+        go::FuncDeclarationAst* func = m_parser->create<go::FuncDeclarationAst>();
+        if(!m_parser->parseIdentifier(&func->funcName) || !m_parser->parseSignature(&func->signature))
+            return 0;
+        declaration->funcDecl = func;
+        function = func;
+        body = &func->body;
+    }
+    qint64 bodyStart = currentToken();
+    if(bodyStart >= limit)
+        return 0;
+    function->startToken = start + 1;
+    function->endToken = bodyStart - 1;
+    if(tokenKind(bodyStart) == go::Parser::Token_LBRACE)
+    {
+        *body = recoverBlock(bodyStart, limit);
+        function->endToken = (*body)->endToken;
+    }
+    else
+        addSyntaxError(bodyStart, limit - 1);
+    declaration->startToken = start;
+    declaration->endToken = function->endToken;
+    return declaration;
 }
 
+go::BlockAst* ParseSession::recoverBlock(qint64 lbrace, qint64 limit)
+{
+    go::BlockAst* block = m_parser->create<go::BlockAst>();
+    go::StatementsAst* statements = m_parser->create<go::StatementsAst>();
+    block->statements = statements;
+    block->startToken = lbrace;
+    block->endToken = limit - 1;
+    statements->startToken = lbrace + 1;
+
+    qint64 position = lbrace + 1;
+    while(position < limit)
+    {
+        int kind = tokenKind(position);
+        if(kind == go::Parser::Token_RBRACE)
+        {
+            block->endToken = position;
+            break;
+        }
+        if(kind == go::Parser::Token_SEMICOLON)
+        {
+            position++;
+            continue;
+        }
+        restartParserAt(position);
+        go::StatementAst* statement = 0;
+        if(m_parser->parseStatement(&statement) && currentToken() > position && currentToken() < limit
+            && (tokenKind(currentToken()) == go::Parser::Token_SEMICOLON || tokenKind(currentToken()) == go::Parser::Token_RBRACE))
+        {
+            statements->statementSequence = KDevPG::snoc(statements->statementSequence, statement, m_pool);
+            position = currentToken();
+            continue;
+        }
+        //skip to the end of broken statement: semicolon or closing brace on the same nesting level
+        qint64 end = position;
+        int depth = 0;
+        for(; end < limit; ++end)
+        {
+            int endKind = tokenKind(end);
+            if(endKind == go::Parser::Token_LBRACE)
+                depth++;
+            else if(endKind == go::Parser::Token_RBRACE)
+            {
+                if(depth == 0)
+                    break;
+                depth--;
+            }
+            else if(endKind == go::Parser::Token_SEMICOLON && depth == 0)
+                break;
+        }
+        addSyntaxError(position, end - 1);
+        position = end;
+    }
+    statements->endToken = qMax(statements->startToken, block->endToken - 1);
+    return block;
+}
 
 go::StartAst* ParseSession::ast()
 {
@@ -119,16 +619,32 @@ QString ParseSession::symbol(qint64 index)
     return QString(m_contents.mid(m_lexer->at(index).begin, m_lexer->at(index).end - m_lexer->at(index).begin+1));
 }
 
-KDevelop::RangeInRevision ParseSession::findRange(go::AstNode* from, go::AstNode* to)
+KDevelop::Identifier ParseSession::identifier(qint64 index)
 {
-    qint64 line, column, lineEnd, columnEnd;
-    m_lexer->locationTable()->positionAt(m_lexer->at(from->startToken).begin, &line, &column);
-    m_lexer->locationTable()->positionAt(m_lexer->at(to->endToken).end+1, &lineEnd, &columnEnd);
-    //for some reason I need to shift columns when not on a first line
-    if(line != 0) column++;
-    if(lineEnd != 0) columnEnd++;
+    if(index < 0 || index >= m_lexer->size())
+        return KDevelop::Identifier();
+    if(index >= m_identifiers.size())
+        m_identifiers.resize(m_lexer->size());
+    KDevelop::Identifier& id = m_identifiers[index];
+    if(id.isEmpty())
+    {
+        const KDevPG::Token& token = m_lexer->at(index);
+        qint64 length = token.end - token.begin + 1;
+        if(length <= 0xffff)
+            id = KDevelop::Identifier(KDevelop::IndexedString(m_contents.constData() + token.begin, length));
+        else
+            id = KDevelop::Identifier(symbol(index));
+        //make identifier constant so copies of it don't allocate
+        id.index();
+    }
+    return id;
+}
 
-    return KDevelop::RangeInRevision(KDevelop::CursorInRevision(line, column), KDevelop::CursorInRevision(lineEnd, columnEnd));
+KDevelop::RangeInRevision ParseSession::findRange(go::AstNode* from, go::AstNode* to)
+{
+    go::TokenPositions::Position start = m_positions->start(from->startToken);
+    go::TokenPositions::Position end = m_positions->end(to->endToken);
+    return KDevelop::RangeInRevision(start.line, start.column, end.line, end.column);
 }
 
 KDevelop::IndexedString ParseSession::currentDocument()
@@ -141,99 +657,129 @@ void ParseSession::setCurrentDocument(const KDevelop::IndexedString& document)
     m_document = document;
 }
 
-/**
- * Currently priority order works in this way
- * 	-1: Direct imports of opened file
- * 	 0: opened files
- * 	...
- * 	 99... imports of imports of imports....
- * 	 99998: Imports of direct imports(needed to resolve types of some function)
- * 	 99999: Reparse of direct imports, after its imports are finished
- * 	 100000: reparse of opened file, after all recursive imports
- * layers higher than 99998 are NOT parsed right now because its too slow
- */
-QList<ReferencedTopDUContext> ParseSession::contextForImport(QString package)
+QString ParseSession::packageDirectory(const QString& importPath)
 {
-    package = package.mid(1, package.length()-2);
-    QStringList files;
+    QString directory = resolveImport(importPath, m_modules);
+    if(directory.isEmpty())
+        return directory;
+    //copies opened in editor keep their own contexts, so their importers see unsaved edits
+    if(hasFilesWithUses(directory))
+        return directory;
+    //identical copies of package are parsed once
+    return go::PackageCache::canonicalDirectory(importPath, directory, [this](const QString& copy) {
+        //imports of a copy are resolved in its own module
+        std::shared_ptr<const go::ModuleGraph> modules = go::ModuleGraph::forDirectory(copy);
+        QStringList directories;
+        for(const QString& import : go::PackageCache::package(copy).imports)
+            directories.append(resolveImport(import, modules));
+        return directories;
+    });
+}
+
+QString ParseSession::resolveImport(const QString& importPath, const std::shared_ptr<const go::ModuleGraph>& modules) const
+{
+    auto hasFiles = [](const QString& directory) {
+        return !directory.isEmpty() && !go::PackageCache::package(directory).files.empty();
+    };
+    QString directory;
     //try canonical paths first
-    if(m_canonicalImports && m_canonicalImports->contains(package))
+    if(m_canonicalImports && m_canonicalImports->contains(importPath))
+        directory = (*m_canonicalImports)[importPath];
+    if(!hasFiles(directory) && modules)
+        directory = modules->packageDirectory(importPath);
+    if(!hasFiles(directory))
+        directory = go::PackageCache::findPackage(importPath, m_includePaths);
+    if(!hasFiles(directory))
+        return QString();
+    return directory;
+}
+
+bool ParseSession::hasFilesWithUses(const QString& directory) const
+{
+    DUChainReadLocker lock;
+    for(const QString& file : go::PackageCache::package(directory).buildFiles)
     {
-        QDir path((*m_canonicalImports)[package]);
-        if(path.exists())
-        {
-            for(const QString& file : path.entryList(QStringList("*.go"), QDir::Files | QDir::NoSymLinks))
-                files.append(path.filePath(file));
-        }
+        TopDUContext* context = DUChain::self()->chainForDocument(IndexedString(file));
+        if(context && (context->features() & TopDUContext::AllDeclarationsContextsAndUses) == TopDUContext::AllDeclarationsContextsAndUses)
+            return true;
     }
-    if(files.empty())
+    return false;
+}
+
+/**
+ * Priority order works in this way
+ * 	-1000: packages that import nothing
+ * 	-1000 + n: packages that import only packages of lower levels
+ * 	...
+ * 	-1000 + depth: other files of package of opened file
+ * 	-1000 + depth + 1: reparse of opened file, after all recursive imports
+ * 	 0: opened files
+ * Jobs use sequential processing, so a level only starts once all levels below it are finished.
+ */
+bool ParseSession::scheduleImportGraph(const QStringList& imports)
+{
+    QString path = m_document.toUrl().toLocalFile();
+    QString directory = m_document.toUrl().adjusted(QUrl::RemoveFilename | QUrl::StripTrailingSlash).toLocalFile();
+    go::ImportGraph graph = go::ImportGraph::build(directory, imports, [this](const QString& importPath) {
+        return packageDirectory(importPath);
+    });
+    QList<QStringList> levels = graph.levels();
+    bool scheduled = false;
+    for(int level = 0; level < levels.size(); ++level)
     {
-        for(const QString& pathname : m_includePaths)
+        for(const QString& package : levels[level])
         {
-            QDir path(pathname);
-            if(path.exists() && path.cd(package))
+            for(const QString& filename : graph.packages()[package].files)
             {
-                for(const QString& file : path.entryList(QStringList("*.go"), QDir::Files | QDir::NoSymLinks))
-                    files.append(path.filePath(file));
+                if(filename == path)
+                    continue;
+                IndexedString url(filename);
+                DUChainReadLocker lock;
+                ReferencedTopDUContext context = DUChain::self()->chainForDocument(url);
+                lock.unlock();
+                if(context)
+                    continue;
+                if(scheduleForParsing(url, ImportGraphPriority + level, (TopDUContext::Features)(TopDUContext::ForceUpdate | TopDUContext::AllDeclarationsAndContexts)))
+                    scheduled = true;
+                //job of one file builds the whole package
                 break;
             }
         }
     }
+    if(scheduled)
+        scheduleForParsing(m_document, ImportGraphPriority + levels.size(), (TopDUContext::Features)(m_features | TopDUContext::ForceUpdate));
+    return scheduled;
+}
+
+QList<ReferencedTopDUContext> ParseSession::contextForImport(QString package, QString* packageName, QString* packageDirectory)
+{
+    package = package.mid(1, package.length()-2);
+    QString directory = this->packageDirectory(package);
+    if(directory.isEmpty())
+        return QList<ReferencedTopDUContext>();
+    go::PackageCache::Package found = go::PackageCache::package(directory);
+    if(packageName)
+        *packageName = found.name;
+    if(packageDirectory)
+        *packageDirectory = directory;
     QList<ReferencedTopDUContext> contexts;
-    bool shouldReparse=false;
-    //reduce priority if it is recursive import
-    //int priority = forExport ? m_priority + 2 : m_priority - 1;
-    int priority = BackgroundParser::WorstPriority;
-    if(!forExport)
-        priority = -1; //parse direct imports as soon as possible
-    else if(m_priority<=-1)
-        priority = BackgroundParser::WorstPriority-2;//imports of direct imports to the stack bottom
-    else
-        priority = m_priority - 2;//currently parsejob does not get created in this cases to reduce recursion
-    for(QString filename : files)
+    //test files are not part of binary package, so they are not among build files
+    //we parse test files only if we open them in KDevelop
+    for(const QString& filename : found.buildFiles)
     {
-        QFile file(filename);
-        if(!file.exists())
-            continue;
-        //test files are not part of binary package, so we can exclude them
-        //we parse test files only if we open them in KDevelop
-        if(filename.endsWith("_test.go"))
-            continue;
-
         IndexedString url(filename);
         DUChainReadLocker lock;
         ReferencedTopDUContext context = DUChain::self()->chainForDocument(url);
         lock.unlock();
         if(context)
             contexts.append(context);
-        else
-        {
-            if(scheduleForParsing(url, priority, (TopDUContext::Features)(TopDUContext::ForceUpdate | TopDUContext::AllDeclarationsAndContexts)))
-                shouldReparse = true;
-        }
     }
-    if(shouldReparse) 
-    //reparse this file after its imports are done
-	scheduleForParsing(m_document, priority+1, (TopDUContext::Features)(m_features | TopDUContext::ForceUpdate));
-
-    if(!forExport && m_priority != BackgroundParser::WorstPriority)//always schedule last reparse after all recursive imports are done
-        scheduleForParsing(m_document, BackgroundParser::WorstPriority, (TopDUContext::Features)(m_features | TopDUContext::ForceUpdate));
     return contexts;
 }
 
 bool ParseSession::scheduleForParsing(const IndexedString& url, int priority, TopDUContext::Features features)
 {
     BackgroundParser* bgparser = KDevelop::ICore::self()->languageController()->backgroundParser();
-    //TopDUContext::Features features = (TopDUContext::Features)(TopDUContext::ForceUpdate | TopDUContext::VisibleDeclarationsAndContexts);//(TopDUContext::Features)
-	//(TopDUContext::ForceUpdate | TopDUContext::AllDeclarationsContextsAndUses);
-
-    //currently recursive imports work really slow, nor they usually needed
-    //so disallow recursive imports
-    int levels=1; //allowed levels of recursion
-    if(forExport && priority >= BackgroundParser::InitialParsePriority && priority < BackgroundParser::WorstPriority - 2*levels)
-    //if(forExport)
-	return false;
-	
     if (bgparser->isQueued(url)) 
     {
 	if (bgparser->priorityForDocument(url) > priority ) 
@@ -248,43 +794,75 @@ bool ParseSession::scheduleForParsing(const IndexedString& url, int priority, To
 
 /**
  * Reparse files that import current context.
- * Only works for opened files, so another opened files get notified of changed context
+ * Only works for opened files, so another opened files get notified of changed context.
+ * Only the document being edited (priority 0) notifies them, importers are rebuilt with worse priority,
+ * so their exports changing in turn doesn't cascade through everything importing them.
+ * Importers are collected first and then scheduled as one batch of the same priority,
+ * so background parser can rebuild them in parallel.
  */
 void ParseSession::reparseImporters(DUContext* context)
 {
-    DUChainReadLocker lock;
-
-    if(forExport || m_priority!=0)
+    if(forExport || m_priority != 0)
 	return;
-    for (DUContext* importer : context->importers()) {
-        scheduleForParsing(importer->url(), BackgroundParser::WorstPriority, (TopDUContext::Features)(importer->topContext()->features() | TopDUContext::ForceUpdate));
+    QList<QPair<IndexedString, TopDUContext::Features>> importers;
+    {
+        DUChainReadLocker lock;
+        QSet<IndexedString> seen;
+        for (DUContext* importer : context->importers()) {
+            IndexedString url = importer->url();
+            if(url == m_document || seen.contains(url))
+                continue;
+            seen.insert(url);
+            importers.append(qMakePair(url, importer->topContext()->features()));
+        }
+    }
+    for(const auto& importer : importers)
+        scheduleForParsing(importer.first, BackgroundParser::WorstPriority, (TopDUContext::Features)(importer.second | TopDUContext::ForceUpdate));
+}
+
+void ParseSession::reparsePackageImporters(const QList<ReferencedTopDUContext>& contexts, const QStringList& packageFiles)
+{
+    QList<QPair<IndexedString, TopDUContext::Features>> importers;
+    {
+        DUChainReadLocker lock;
+        QSet<IndexedString> seen;
+        for(const ReferencedTopDUContext& context : contexts)
+        {
+            for (DUContext* importer : context->importers()) {
+                IndexedString url = importer->url();
+                TopDUContext::Features features = importer->topContext()->features();
+                //other packages importing this one are rebuilt with their own jobs, when their imports are scheduled
+                if(seen.contains(url) || packageFiles.contains(url.str())
+                    || (features & TopDUContext::AllDeclarationsContextsAndUses) != TopDUContext::AllDeclarationsContextsAndUses)
+                    continue;
+                seen.insert(url);
+                importers.append(qMakePair(url, features));
+            }
+        }
     }
+    for(const auto& importer : importers)
+        scheduleForParsing(importer.first, BackgroundParser::WorstPriority, (TopDUContext::Features)(importer.second | TopDUContext::ForceUpdate));
 }
 
-QList< ReferencedTopDUContext > ParseSession::contextForThisPackage(IndexedString package)
+QList< ReferencedTopDUContext > ParseSession::contextForThisPackage(IndexedString package, const QString& packageName)
 {
     QList<ReferencedTopDUContext> contexts;
     QUrl url = package.toUrl();
-    QDir path(url.adjusted(QUrl::RemoveFilename).path());
-    if(path.exists())
+    go::PackageCache::Package directory = go::PackageCache::package(url.adjusted(QUrl::RemoveFilename | QUrl::StripTrailingSlash).path());
+    if(directory.exists)
     {
-        int priority = BackgroundParser::WorstPriority;
-        if(!forExport)
-            priority = -1; //import this package as soon as possible
-        else if(m_priority<=-1)
-            priority = BackgroundParser::WorstPriority-2;//all needed files should be scheduled already
-        else
-            priority = m_priority;//currently parsejob does not get created in this cases to reduce recursion
-	 QStringList files = path.entryList(QStringList("*.go"), QDir::Files | QDir::NoSymLinks);
+        //when editing file for another platform, its siblings for that platform are wanted
+        QString path = url.toLocalFile();
+        bool filterBuild = directory.buildFiles.contains(path) || (path.endsWith("_test.go") && directory.packageNames.value(path) == directory.name);
 	 bool shouldReparse=false;
-	 for(QString filename : files)
+	 for(const QString& filename : directory.files)
 	 {
-	    filename = path.filePath(filename);
-	    QFile file(filename);
-	    if(!file.exists())
-		continue;
             if(forExport && filename.endsWith("_test.go"))
                 continue;
+            if(!packageName.isEmpty() && directory.packageNames.value(filename) != packageName)
+                continue;
+            if(filterBuild && !filename.endsWith("_test.go") && !directory.buildFiles.contains(filename))
+                continue;
 	
 	    IndexedString url(filename);
 	    DUChainReadLocker lock; 
@@ -292,15 +870,16 @@ QList< ReferencedTopDUContext > ParseSession::contextForThisPackage(IndexedStrin
 	    lock.unlock();
 	    if(context)
 		contexts.append(context);
-	    else
+	    //packages being imported are scheduled with import graph, only opened file picks up files it still misses
+	    else if(!forExport)
 	    {
-		if(scheduleForParsing(url, priority, (TopDUContext::Features)(TopDUContext::ForceUpdate | TopDUContext::AllDeclarationsAndContexts)))
+		if(scheduleForParsing(url, -1, (TopDUContext::Features)(TopDUContext::ForceUpdate | TopDUContext::AllDeclarationsAndContexts)))
                     shouldReparse=true;
 	    }
 	     
 	 }
 	 if(shouldReparse)
-	     scheduleForParsing(m_document, priority+1, (TopDUContext::Features)(m_features | TopDUContext::ForceUpdate));
+	     scheduleForParsing(m_document, 0, (TopDUContext::Features)(m_features | TopDUContext::ForceUpdate));
     }
     return contexts;
 }
@@ -310,6 +889,8 @@ void ParseSession::setFeatures(TopDUContext::Features features)
     m_features = features;
     if((m_features & TopDUContext::AllDeclarationsContextsAndUses) == TopDUContext::AllDeclarationsAndContexts)
 	forExport = true;
+    //importers only see top level declarations, so don't spend time on function bodies
+    m_parser->skipFunctionBodies = forExport;
 }
 
 QString ParseSession::textForNode(go::AstNode* node)
@@ -317,6 +898,35 @@ QString ParseSession::textForNode(go::AstNode* node)
     return QString(m_contents.mid(m_lexer->at(node->startToken).begin, m_lexer->at(node->endToken).end - m_lexer->at(node->startToken).begin+1));
 }
 
+void ParseSession::mapAstUse(go::AstNode* node, const SimpleUses& uses)
+{
+    m_uses[node] = uses;
+}
+
+bool ParseSession::mappedUses(go::AstNode* node, SimpleUses* uses) const
+{
+    auto iter = m_uses.constFind(node);
+    if(iter == m_uses.constEnd())
+        return false;
+    *uses = iter.value();
+    return true;
+}
+
+void ParseSession::memoizeExpression(go::AstNode* node, DUContext* context, const MemoizedExpression& result)
+{
+    m_expressions[qMakePair(node, context)] = result;
+}
+
+bool ParseSession::memoizedExpression(go::AstNode* node, DUContext* context, MemoizedExpression* result) const
+{
+    auto iter = m_expressions.constFind(qMakePair(node, context));
+    if(iter == m_expressions.constEnd())
+        return false;
+    m_expressionHits++;
+    *result = iter.value();
+    return true;
+}
+
 void ParseSession::setIncludePaths(const QList<QString>& paths)
 {
     m_includePaths = paths;
@@ -324,6 +934,10 @@ void ParseSession::setIncludePaths(const QList<QString>& paths)
 
 QByteArray ParseSession::commentBeforeToken(qint64 token)
 {
+    //doc comment has to end a line before token, so there can't be one
+    //if previous token ends on the same line as this one starts
+    if(token > 0 && m_positions->end(token-1).line == m_positions->start(token).line)
+        return QByteArray();
     int commentEnd = m_lexer->at(token).begin;
     int commentStart = 0;
     if(token - 1 >= 0)
@@ -401,8 +1015,13 @@ QByteArray ParseSession::commentBeforeToken(qint64 token)
     return QByteArray();
 }
 
-void ParseSession::setCanonicalImports(QHash< QString, QString >* imports)
+void ParseSession::setCanonicalImports(const QHash<QString, QString>* imports)
 {
     m_canonicalImports = imports;
 }
 
+void ParseSession::setModuleGraph(const std::shared_ptr<const go::ModuleGraph>& modules)
+{
+    m_modules = modules;
+}
+
@@ -22,6 +22,13 @@
 #include <language/editor/rangeinrevision.h>
 #include <language/duchain/topducontext.h>
 #include <serialization/indexedstring.h>
+#include <language/duchain/identifier.h>
+#include <language/duchain/types/abstracttype.h>
+
+#include <QHash>
+#include <QVector>
+
+#include <memory>
 
 #include "goparserexport.h"
 #include "parser/goast.h"
@@ -36,13 +43,52 @@ namespace go
 class Lexer;
 class Parser;
 class StartAst;
+class TokenPositions;
+class ModuleGraph;
 }
 
-typedef QPair<KDevelop::DUContextPointer, KDevelop::RangeInRevision> SimpleUse;
+/**
+ * Identifiers of an expression together with declarations they were resolved to.
+ **/
+typedef QList<QPair<go::IdentifierAst*, KDevelop::DeclarationPointer>> SimpleUses;
+
+/**
+ * Result of evaluating an expression, kept so nested expressions are evaluated once per build.
+ **/
+struct MemoizedExpression
+{
+    QList<KDevelop::AbstractType::Ptr> types;
+    SimpleUses uses;
+    bool setsDeclaration = false;
+    KDevelop::DeclarationPointer declaration;
+};
 
 class KDE_EXPORT ParseSession
 {
 public:
+
+    /**
+     * Controls how tokens get from lexer to parser.
+     * Streaming: parser pulls tokens from lexer on demand, so source is only walked once.
+     * Prelexed: whole file is lexed before parsing starts. This is the old behaviour,
+     * which is only useful to compare against streaming mode or to debug lexer.
+     **/
+    enum TokenizationMode
+    {
+        Streaming,
+        Prelexed
+    };
+
+    /**
+     * Which lexer produces tokens. Hand-written lexer(see go::FastLexer) produces the same tokens
+     * as the one generated from go.g, but is faster. It always lexes whole file before parsing,
+     * so tokenization mode doesn't matter for it.
+     **/
+    enum LexerBackend
+    {
+        GeneratedLexer,
+        HandWrittenLexer
+    };
   
     ParseSession(const QByteArray& contents, int priority, bool appendWithNewline=true);
     
@@ -55,9 +101,81 @@ public:
     bool parseExpression(go::ExpressionAst **node);
     
     go::StartAst* ast();
+
+    void setTokenizationMode(TokenizationMode mode);
+
+    TokenizationMode tokenizationMode() const;
+
+    /**
+     * Has to be called before startParsing() or parseExpression().
+     **/
+    void setLexerBackend(LexerBackend backend);
+
+    LexerBackend lexerBackend() const;
+
+    /**
+     * Returns true if lexer met a symbol it couldn't recognize.
+     * In streaming mode this is only known after parsing has finished.
+     **/
+    bool hasLexerErrors() const;
+
+    /**
+     * Bytes allocated by memory pool of this session, which holds its AST.
+     **/
+    qint64 memoryUsage() const;
+
+    /**
+     * Returns true if startParsing() failed, but declarations and statements not affected
+     * by syntax errors have been recovered into a partial ast(), which can still be built.
+     **/
+    bool isRecovered() const;
+
+    /**
+     * Ranges of code which had to be skipped during error recovery.
+     **/
+    QList<KDevelop::RangeInRevision> syntaxErrors();
+
+    /**
+     * Enables reuse of function bodies unchanged since the last incremental parse of current document.
+     * Reused bodies are left out of ast() and builders keep their contexts from existing DUChain.
+     * Has to be called before startParsing().
+     **/
+    void setIncrementalParsing(bool enabled);
+
+    /**
+     * Remembers function bodies of this parse for the next incremental parse of current document.
+     * Call after DUChain has been built from ast(), so that it has contexts for all of them.
+     **/
+    void rememberFunctionBodies();
+
+    /**
+     * Returns true if body of function or method declaration @p function was skipped as unchanged.
+     **/
+    bool isBodyReused(go::AstNode* function);
+
+    KDevelop::RangeInRevision reusedBodyRange(go::AstNode* function);
+
+    /**
+     * Range skipped body of @p function had in the text DUChain was last built from.
+     * Differs from reusedBodyRange() when lines were added or removed above the body.
+     **/
+    KDevelop::RangeInRevision previousBodyRange(go::AstNode* function);
+
+    /**
+     * Parses skipped body of @p function after all, for when there is no context to reuse for it.
+     **/
+    go::BlockAst* parseReusedBody(go::AstNode* function);
     
     QString symbol(qint64 index);
 
+    /**
+     * Returns interned identifier for token at @p index.
+     * Identifier is created on first request and cached for the rest of the session,
+     * so builders and visitors asking for the same token again only pay for an array load.
+     * Returned by value, since cache grows with the token stream; copies of indexed identifiers don't allocate.
+     **/
+    KDevelop::Identifier identifier(qint64 index);
+
     KDevelop::RangeInRevision findRange(go::AstNode* from, go::AstNode* to);
 
     KDevelop::IndexedString currentDocument();
@@ -66,21 +184,68 @@ public:
 
     KDevelop::IndexedString url();
 
-    QList<KDevelop::ReferencedTopDUContext> contextForImport(QString package);
+    /**
+     * Returns directory of package imported as @p importPath, looked up in canonical imports, module graph
+     * and search paths, in this order. Returns an empty string if there is no such package.
+     * Byte-identical copies of a package resolve to the same directory, see PackageCache::canonicalDirectory(),
+     * except for copies with files opened in editor.
+     */
+    QString packageDirectory(const QString& importPath);
+
+    /**
+     * Schedules packages this package depends on, directly or not, that aren't parsed yet.
+     * Packages are parsed bottom up, each after all packages it imports, the ones of the same level in parallel.
+     * Only one file of each package is scheduled, its job builds other files of package as well.
+     * Other files of this package come last, then current document is reparsed. @p imports of current
+     * document are added to imports of package, as they may be not saved yet.
+     * Returns true if anything was scheduled.
+     */
+    bool scheduleImportGraph(const QStringList& imports);
+
+    /**
+     * Returns contexts of files that make up imported @p package in current build context.
+     * Packages are not scheduled from here, that is done for the whole graph by scheduleImportGraph().
+     * If @p packageName is given, it is set to package name declared by these files,
+     * and @p directory to directory they were found in.
+     */
+    QList<KDevelop::ReferencedTopDUContext> contextForImport(QString package, QString* packageName = 0, QString* directory = 0);
 
-    QList<KDevelop::ReferencedTopDUContext> contextForThisPackage(KDevelop::IndexedString package);
+    /**
+     * Returns contexts of other files of package @p packageName in directory of @p package.
+     * Files excluded by build constraints are skipped, unless @p package itself is excluded.
+     */
+    QList<KDevelop::ReferencedTopDUContext> contextForThisPackage(KDevelop::IndexedString package, const QString& packageName = QString());
 
     bool scheduleForParsing(const KDevelop::IndexedString& url, int priority, KDevelop::TopDUContext::Features features);
 
+    //priority of packages that import nothing, packages of higher levels of import graph get higher priority numbers
+    static const int ImportGraphPriority = -1000;
+
+    /**
+     * Schedules files importing @p context for rebuilding. Called when exports of current document changed.
+     */
     void reparseImporters(KDevelop::DUContext* context);
 
+    /**
+     * Schedules files built with uses, which import any of @p contexts, for rebuilding.
+     * Called by jobs building a whole package, once exports of @p contexts changed.
+     * Importers among @p packageFiles were built together with them and are skipped.
+     */
+    void reparsePackageImporters(const QList<KDevelop::ReferencedTopDUContext>& contexts, const QStringList& packageFiles);
+
     void setFeatures(KDevelop::TopDUContext::Features features);
 
     QString textForNode(go::AstNode* node);
 
     void setIncludePaths(const QList<QString> &paths);
 
-    void setCanonicalImports(QHash<QString, QString>* imports);
+    void setCanonicalImports(const QHash<QString, QString>* imports);
+
+    /**
+     * Sets modules of current document's workspace. Imports from them are resolved
+     * by module graph before include paths are searched.
+     **/
+    void setModuleGraph(const std::shared_ptr<const go::ModuleGraph>& modules);
 
     /**
      * Returns doc comment preceding given token.
@@ -98,18 +263,103 @@ public:
      */
     friend go::Lexer* getLexer(const ParseSession& session) { return session.m_lexer; }
     
-    void mapAstUse(go::AstNode* node, const SimpleUse& use)
-    {
-        Q_UNUSED(node);
-        Q_UNUSED(use);
-    }
+    /**
+     * Remembers declarations identifiers of @p node were resolved to while building declarations,
+     * so UseBuilder doesn't need to repeat lookups for the same expression.
+     **/
+    void mapAstUse(go::AstNode* node, const SimpleUses& uses);
+
+    /**
+     * Returns false if @p node was not resolved while building declarations.
+     * Declarations deleted since then are returned as null pointers.
+     **/
+    bool mappedUses(go::AstNode* node, SimpleUses* uses) const;
+
+    /**
+     * Remembers what evaluating @p node in @p context resulted in.
+     * Memo is only valid for current build and is discarded together with session.
+     **/
+    void memoizeExpression(go::AstNode* node, KDevelop::DUContext* context, const MemoizedExpression& result);
+
+    /**
+     * Returns false if @p node wasn't evaluated in @p context yet.
+     **/
+    bool memoizedExpression(go::AstNode* node, KDevelop::DUContext* context, MemoizedExpression* result) const;
+
+    /**
+     * How many times memoizedExpression() found a result.
+     **/
+    int memoizedExpressionHits() const { return m_expressionHits; }
 
 private:
     
     bool lex();
+
+    void createLexer(const QByteArray& input);
+
+    /**
+     * Makes tokens available to parser according to lexer backend and tokenization mode
+     * and rewinds parser to the first token.
+     **/
+    bool prepareTokens();
+
+    /**
+     * Builds partial AST after a syntax error by parsing top level declarations one by one,
+     * skipping to the next top level keyword on a line start when a declaration fails.
+     * Functions with broken bodies keep their signatures and well-formed statements.
+     **/
+    bool recover();
+
+    go::TopLevelDeclarationAst* recoverFunction(qint64 start, qint64 limit);
+
+    /**
+     * Rewinds parser to @p token for another parse attempt, clearing flags left by a failed one.
+     **/
+    void restartParserAt(qint64 token);
+
+    go::BlockAst* recoverBlock(qint64 lbrace, qint64 limit);
+
+    /**
+     * Looks @p importPath up like packageDirectory(), in @p modules instead of module graph of this document.
+     **/
+    QString resolveImport(const QString& importPath, const std::shared_ptr<const go::ModuleGraph>& modules) const;
+
+    /**
+     * Whether any build file in @p directory is built with uses, i.e. opened in editor.
+     **/
+    bool hasFilesWithUses(const QString& directory) const;
+
+    qint64 nextTopLevelBoundary(qint64 from);
+
+    int tokenKind(qint64 index);
+
+    qint64 currentToken();
+
+    void addSyntaxError(qint64 startToken, qint64 endToken);
+
+    /**
+     * Byte offsets of a top level function or method: its func keyword and braces of its body.
+     **/
+    struct FunctionSpan
+    {
+        qint64 declaration;
+        qint64 bodyStart;
+        qint64 bodyEnd;
+    };
+
+    /**
+     * Marks bodies of @p previousContents whose whole declarations are outside of changed region as reusable for parser.
+     * Receivers and parameters are declared around the body, so a function whose signature changed is always rebuilt.
+     * Nothing is reused unless the change is confined to one body or only adds or removes blank and comment lines,
+     * because bodies resolve package level names and kept contexts would not notice added or changed declarations.
+     **/
+    void findReusableBodies(const QByteArray& previousContents, const QVector<FunctionSpan>& functions);
+
+    void reportLexerError(qint64 offset);
     
     KDevPG::MemoryPool* m_pool;
     go::Lexer* m_lexer;
+    go::TokenPositions* m_positions;
     go::Parser* m_parser;
     go::StartAst* m_ast;
     QByteArray m_contents;
@@ -119,7 +369,19 @@ private:
     KDevelop::TopDUContext::Features m_features;
     bool forExport;
     QList<QString> m_includePaths;
-    QHash<QString, QString>* m_canonicalImports;
+    const QHash<QString, QString>* m_canonicalImports;
+    std::shared_ptr<const go::ModuleGraph> m_modules;
+    TokenizationMode m_tokenizationMode;
+    LexerBackend m_lexerBackend;
+    bool m_lexerError;
+    QVector<KDevelop::Identifier> m_identifiers;
+    bool m_recovered;
+    QList<QPair<qint64, qint64>> m_syntaxErrors;
+    bool m_incremental;
+    QHash<qint64, KDevelop::RangeInRevision> m_previousBodyRanges;
+    QHash<go::AstNode*, SimpleUses> m_uses;
+    QHash<QPair<go::AstNode*, KDevelop::DUContext*>, MemoizedExpression> m_expressions;
+    mutable int m_expressionHits;
   
 };
 
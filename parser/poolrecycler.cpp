@@ -0,0 +1,144 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "poolrecycler.h"
+
+#include "parser/goparser.h"
+
+#include <QAtomicInteger>
+#include <QThreadStorage>
+#include <QVector>
+
+#include <cstring>
+
+#include "kdev-pg-memory-pool.h"
+
+namespace
+{
+
+//ParseSession needs just one pool at a time, but completion creates sessions
+//while another one is alive, so keep a couple of them
+const int maxCachedPools = 2;
+const int maxCachedParsers = 2;
+//pool which grew this big parsing some generated file isn't worth pinning
+const qint64 maxCachedPoolSize = 16 * 1024 * 1024;
+
+QAtomicInteger<qint64> cachedBytes(0);
+
+struct ThreadCache
+{
+    ~ThreadCache()
+    {
+        for(KDevPG::MemoryPool* pool : pools)
+        {
+            cachedBytes.fetchAndAddRelaxed(-go::PoolRecycler::poolSize(pool));
+            delete pool;
+        }
+        qDeleteAll(parsers);
+    }
+
+    QVector<KDevPG::MemoryPool*> pools;
+    QVector<go::Parser*> parsers;
+};
+
+QThreadStorage<ThreadCache*> threadCache;
+
+ThreadCache* localCache()
+{
+    if(!threadCache.hasLocalData())
+        threadCache.setLocalData(new ThreadCache());
+    return threadCache.localData();
+}
+
+void resetPool(KDevPG::MemoryPool* pool)
+{
+    for(KDevPG::MemoryPool::BlockType* block = &pool->blk; block; block = block->chain)
+    {
+        memset(block->data, 0, block->ptr - block->data);
+        block->ptr = block->data;
+    }
+    pool->rightMost = &pool->blk;
+}
+
+}
+
+namespace go
+{
+
+KDevPG::MemoryPool* PoolRecycler::acquirePool()
+{
+    ThreadCache* cache = localCache();
+    if(cache->pools.isEmpty())
+        return new KDevPG::MemoryPool();
+    KDevPG::MemoryPool* pool = cache->pools.takeLast();
+    cachedBytes.fetchAndAddRelaxed(-poolSize(pool));
+    return pool;
+}
+
+void PoolRecycler::releasePool(KDevPG::MemoryPool* pool)
+{
+    if(!pool)
+        return;
+    ThreadCache* cache = localCache();
+    qint64 size = poolSize(pool);
+    if(cache->pools.size() >= maxCachedPools || size > maxCachedPoolSize)
+    {
+        delete pool;
+        return;
+    }
+    resetPool(pool);
+    cache->pools.append(pool);
+    cachedBytes.fetchAndAddRelaxed(size);
+}
+
+go::Parser* PoolRecycler::acquireParser()
+{
+    ThreadCache* cache = localCache();
+    if(cache->parsers.isEmpty())
+        return new go::Parser();
+    return cache->parsers.takeLast();
+}
+
+void PoolRecycler::releaseParser(go::Parser* parser)
+{
+    if(!parser)
+        return;
+    ThreadCache* cache = localCache();
+    if(cache->parsers.size() >= maxCachedParsers)
+    {
+        delete parser;
+        return;
+    }
+    parser->resetState();
+    cache->parsers.append(parser);
+}
+
+qint64 PoolRecycler::warmBytes()
+{
+    return cachedBytes.load();
+}
+
+qint64 PoolRecycler::poolSize(KDevPG::MemoryPool* pool)
+{
+    qint64 size = 0;
+    for(KDevPG::MemoryPool::BlockType* block = &pool->blk; block; block = block->chain)
+        size += block->blockSize;
+    return size;
+}
+
+}
@@ -0,0 +1,70 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGPOOLRECYCLER_H
+#define GOLANGPOOLRECYCLER_H
+
+#include <QtGlobal>
+
+#include "goparserexport.h"
+
+namespace KDevPG
+{
+class MemoryPool;
+}
+
+namespace go
+{
+class Parser;
+
+/**
+ * Keeps memory pools and parsers of finished ParseSessions per thread,
+ * so next session on the same thread can reuse them instead of allocating.
+ * Pools are reset by zeroing their used parts, which keeps all their blocks
+ * allocated(AST nodes rely on zeroed memory).
+ * Lexers are not recycled, because they are bound to the input they were created for.
+ */
+class KDEVGOPARSER_EXPORT PoolRecycler
+{
+public:
+    static KDevPG::MemoryPool* acquirePool();
+
+    /**
+     * Returns pool to the current thread's cache or frees it if the cache is full
+     * or pool has grown too big to be worth keeping.
+     */
+    static void releasePool(KDevPG::MemoryPool* pool);
+
+    static go::Parser* acquireParser();
+
+    static void releaseParser(go::Parser* parser);
+
+    /**
+     * Number of bytes currently held by cached pools of all threads.
+     */
+    static qint64 warmBytes();
+
+    /**
+     * Number of bytes allocated by blocks of @p pool.
+     */
+    static qint64 poolSize(KDevPG::MemoryPool* pool);
+};
+
+}
+
+#endif
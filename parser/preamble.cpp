@@ -0,0 +1,521 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "preamble.h"
+#include "packagecache.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QRegExp>
+#include <QSet>
+#include <QSysInfo>
+
+#include <cctype>
+
+namespace go
+{
+
+namespace
+{
+
+const QSet<QString> knownOS{"aix", "android", "darwin", "dragonfly", "freebsd", "hurd", "illumos", "ios", "js",
+                            "linux", "nacl", "netbsd", "openbsd", "plan9", "solaris", "wasip1", "windows", "zos"};
+const QSet<QString> unixOS{"aix", "android", "darwin", "dragonfly", "freebsd", "hurd", "illumos", "ios",
+                           "linux", "netbsd", "openbsd", "solaris"};
+const QSet<QString> knownArch{"386", "amd64", "amd64p32", "arm", "armbe", "arm64", "arm64be", "loong64", "mips",
+                              "mipsle", "mips64", "mips64le", "mips64p32", "mips64p32le", "ppc", "ppc64", "ppc64le",
+                              "riscv", "riscv64", "s390", "s390x", "sparc", "sparc64", "wasm"};
+
+QMutex currentContextMutex;
+BuildContext* currentContext = 0;
+
+//preambles are read in growing steps, up to the limit
+const qint64 firstReadStep = 4096;
+const qint64 readLimit = 256 * 1024;
+
+BuildContext environmentContext()
+{
+    BuildContext context;
+    QString hostOS = QSysInfo::kernelType();
+    if(hostOS == "winnt")
+        hostOS = "windows";
+    QString hostArch = QSysInfo::currentCpuArchitecture();
+    if(hostArch == "x86_64")
+        hostArch = "amd64";
+    else if(hostArch == "i386")
+        hostArch = "386";
+    context.goos = QString::fromLocal8Bit(qgetenv("GOOS"));
+    if(context.goos.isEmpty())
+        context.goos = hostOS;
+    context.goarch = QString::fromLocal8Bit(qgetenv("GOARCH"));
+    if(context.goarch.isEmpty())
+        context.goarch = hostArch;
+    //cgo is disabled by default when cross compiling
+    QByteArray cgo = qgetenv("CGO_ENABLED");
+    context.cgo = cgo.isEmpty() ? (context.goos == hostOS && context.goarch == hostArch) : cgo == "1";
+    QStringList flags = QString::fromLocal8Bit(qgetenv("GOFLAGS")).split(' ', QString::SkipEmptyParts);
+    for(int i = 0; i < flags.size(); ++i)
+    {
+        QString flag = flags[i];
+        if(flag.startsWith("--"))
+            flag.remove(0, 1);
+        if(flag.startsWith("-tags="))
+            context.tags += flag.mid(6).split(',', QString::SkipEmptyParts);
+        else if(flag == "-tags" && i + 1 < flags.size())
+            context.tags += flags[++i].split(',', QString::SkipEmptyParts);
+    }
+    return context;
+}
+
+/**
+ * Recursive descent evaluator of //go:build expressions.
+ */
+class ExpressionEvaluator
+{
+public:
+    ExpressionEvaluator(const BuildContext& context, const QString& expression) : m_context(context), m_position(0), m_error(false)
+    {
+        int i = 0;
+        while(i < expression.size())
+        {
+            if(expression[i].isSpace())
+                i++;
+            else if(expression.midRef(i, 2) == QLatin1String("&&") || expression.midRef(i, 2) == QLatin1String("||"))
+            {
+                m_tokens.append(expression.mid(i, 2));
+                i += 2;
+            }
+            else if(expression[i] == '!' || expression[i] == '(' || expression[i] == ')')
+                m_tokens.append(expression.mid(i++, 1));
+            else if(expression[i].isLetterOrNumber() || expression[i] == '_' || expression[i] == '.')
+            {
+                int start = i;
+                while(i < expression.size() && (expression[i].isLetterOrNumber() || expression[i] == '_' || expression[i] == '.'))
+                    i++;
+                m_tokens.append(expression.mid(start, i - start));
+            }
+            else
+            {
+                m_error = true;
+                return;
+            }
+        }
+    }
+
+    bool evaluate()
+    {
+        if(m_error)
+            return true;
+        bool result = parseOr();
+        return m_error || m_position != m_tokens.size() ? true : result;
+    }
+
+private:
+    QString next() const
+    {
+        return m_position < m_tokens.size() ? m_tokens[m_position] : QString();
+    }
+
+    bool parseOr()
+    {
+        bool result = parseAnd();
+        while(next() == "||")
+        {
+            m_position++;
+            bool right = parseAnd();
+            result = result || right;
+        }
+        return result;
+    }
+
+    bool parseAnd()
+    {
+        bool result = parseNot();
+        while(next() == "&&")
+        {
+            m_position++;
+            bool right = parseNot();
+            result = result && right;
+        }
+        return result;
+    }
+
+    bool parseNot()
+    {
+        QString token = next();
+        m_position++;
+        if(token == "!")
+            return !parseNot();
+        if(token == "(")
+        {
+            bool result = parseOr();
+            if(next() != ")")
+                m_error = true;
+            m_position++;
+            return result;
+        }
+        if(token.isEmpty() || token == ")" || token == "&&" || token == "||")
+        {
+            m_error = true;
+            return false;
+        }
+        return m_context.hasTag(token);
+    }
+
+    const BuildContext& m_context;
+    QStringList m_tokens;
+    int m_position;
+    bool m_error;
+};
+
+bool isIdentifierChar(char c)
+{
+    return isalnum(static_cast<unsigned char>(c)) || c == '_' || static_cast<unsigned char>(c) >= 0x80;
+}
+
+/**
+ * Walks preamble of a file. All scanning functions return false when data ends too early
+ * or doesn't look like Go, with complete flag telling these apart.
+ */
+class PreambleScanner
+{
+public:
+    PreambleScanner(const QByteArray& data, Preamble& preamble) : m_data(data), m_preamble(preamble), m_i(0)
+    {
+    }
+
+    void scan()
+    {
+        if(!scanHeader() || !scanPackageClause())
+            return;
+        while(skipSpaces())
+        {
+            if(m_i + 6 >= m_data.size())
+                return;
+            if(!m_data.mid(m_i, 6).startsWith("import") || isIdentifierChar(m_data[m_i + 6]))
+            {
+                m_preamble.complete = true;
+                return;
+            }
+            m_i += 6;
+            if(!skipSpaces())
+                return;
+            if(m_data[m_i] == '(')
+            {
+                m_i++;
+                while(true)
+                {
+                    if(!skipSpaces())
+                        return;
+                    if(m_data[m_i] == ')')
+                    {
+                        m_i++;
+                        break;
+                    }
+                    if(!scanImportSpec())
+                        return;
+                }
+            }
+            else if(!scanImportSpec())
+                return;
+        }
+    }
+
+private:
+    /**
+     * Collects build constraints from line comments before package clause. Only comment groups
+     * followed by a blank line count, the one right before package clause is package documentation.
+     */
+    bool scanHeader()
+    {
+        QList<QByteArray> group;
+        bool lineStart = true;
+        while(true)
+        {
+            while(m_i < m_data.size() && (m_data[m_i] == ' ' || m_data[m_i] == '\t' || m_data[m_i] == '\r'))
+                m_i++;
+            if(m_i >= m_data.size())
+                return false;
+            if(m_data[m_i] == '\n')
+            {
+                if(lineStart)
+                {
+                    addConstraints(group);
+                    group.clear();
+                }
+                lineStart = true;
+                m_i++;
+            }
+            else if(m_data.mid(m_i, 2) == "//")
+            {
+                int end = m_data.indexOf('\n', m_i);
+                if(end == -1)
+                    return false;
+                group.append(m_data.mid(m_i + 2, end - m_i - 2));
+                m_i = end + 1;
+                lineStart = true;
+            }
+            else if(m_data.mid(m_i, 2) == "/*")
+            {
+                int end = m_data.indexOf("*/", m_i + 2);
+                if(end == -1)
+                    return false;
+                group.clear();
+                m_i = end + 2;
+                lineStart = false;
+            }
+            else
+                return true;
+        }
+    }
+
+    void addConstraints(const QList<QByteArray>& group)
+    {
+        for(const QByteArray& line : group)
+        {
+            if(line.startsWith("go:build") && (line.size() == 8 || isspace(static_cast<unsigned char>(line[8]))))
+                m_preamble.goBuild = QString::fromUtf8(line.mid(8)).trimmed();
+            else
+            {
+                QByteArray trimmed = line.trimmed();
+                if(trimmed.startsWith("+build") && (trimmed.size() == 6 || isspace(static_cast<unsigned char>(trimmed[6]))))
+                    m_preamble.plusBuild.append(QString::fromUtf8(trimmed.mid(6)).trimmed());
+            }
+        }
+    }
+
+    bool scanPackageClause()
+    {
+        if(m_i + 8 > m_data.size())
+            return false;
+        if(!m_data.mid(m_i, 8).startsWith("package") || isIdentifierChar(m_data[m_i + 7]))
+        {//not a Go file
+            m_preamble.complete = true;
+            return false;
+        }
+        int end = m_data.indexOf('\n', m_i);
+        if(end == -1)
+            return false;
+        QString clause = QString::fromUtf8(m_data.mid(m_i, end - m_i));
+        m_i = end + 1;
+        QRegExp packageClause("^package\\s+(\\w+)(\\s*(//|/\\*)\\s*import\\s*\"([^\"]*)\")?");
+        if(packageClause.indexIn(clause) != 0)
+        {
+            m_preamble.complete = true;
+            return false;
+        }
+        m_preamble.packageName = packageClause.cap(1);
+        m_preamble.canonicalImport = packageClause.cap(4);
+        //block comment opened after package name may go on for several lines
+        int commentStart = clause.indexOf("/*", packageClause.pos(1) + packageClause.cap(1).size());
+        if(commentStart != -1 && clause.indexOf("*/", commentStart + 2) == -1)
+        {
+            int commentEnd = m_data.indexOf("*/", m_i);
+            if(commentEnd == -1)
+                return false;
+            m_i = commentEnd + 2;
+        }
+        return true;
+    }
+
+    /**
+     * Skips spaces, line breaks, semicolons and comments. Returns false if data ends.
+     */
+    bool skipSpaces()
+    {
+        while(m_i < m_data.size())
+        {
+            char c = m_data[m_i];
+            if(isspace(static_cast<unsigned char>(c)) || c == ';')
+                m_i++;
+            else if(m_data.mid(m_i, 2) == "//")
+            {
+                int end = m_data.indexOf('\n', m_i);
+                if(end == -1)
+                    return false;
+                m_i = end + 1;
+            }
+            else if(m_data.mid(m_i, 2) == "/*")
+            {
+                int end = m_data.indexOf("*/", m_i + 2);
+                if(end == -1)
+                    return false;
+                m_i = end + 2;
+            }
+            else
+                return true;
+        }
+        return false;
+    }
+
+    bool scanImportSpec()
+    {
+        //optional package name, dot or blank identifier
+        if(m_data[m_i] == '.')
+            m_i++;
+        else
+        {
+            while(m_i < m_data.size() && isIdentifierChar(m_data[m_i]))
+                m_i++;
+        }
+        if(!skipSpaces())
+            return false;
+        char quote = m_data[m_i];
+        if(quote != '"' && quote != '`')
+        {
+            m_preamble.complete = true;
+            return false;
+        }
+        int end = m_data.indexOf(quote, m_i + 1);
+        if(end == -1)
+            return false;
+        m_preamble.imports.append(QString::fromUtf8(m_data.mid(m_i + 1, end - m_i - 1)));
+        m_i = end + 1;
+        return true;
+    }
+
+    const QByteArray& m_data;
+    Preamble& m_preamble;
+    int m_i;
+};
+
+}
+
+BuildContext BuildContext::current()
+{
+    QMutexLocker lock(&currentContextMutex);
+    if(!currentContext)
+        currentContext = new BuildContext(environmentContext());
+    return *currentContext;
+}
+
+void BuildContext::setCurrent(const BuildContext& context)
+{
+    {
+        QMutexLocker lock(&currentContextMutex);
+        if(!currentContext)
+            currentContext = new BuildContext(context);
+        else
+            *currentContext = context;
+    }
+    //listings know which files are part of build
+    PackageCache::clear();
+}
+
+bool BuildContext::hasTag(const QString& tag) const
+{
+    if(tag == goos || tag == goarch || tags.contains(tag) || tag == "gc")
+        return true;
+    if(tag == "cgo")
+        return cgo;
+    if(tag == "unix")
+        return unixOS.contains(goos);
+    //some platforms imply others
+    if((tag == "linux" && goos == "android") || (tag == "solaris" && goos == "illumos") || (tag == "darwin" && goos == "ios"))
+        return true;
+    //release tags, toolchain is assumed to be recent enough
+    return tag.startsWith("go1.");
+}
+
+bool BuildContext::matchesFileName(const QString& fileName) const
+{
+    QString name = fileName;
+    if(name.endsWith(".go"))
+        name.chop(3);
+    if(name.endsWith("_test"))
+        name.chop(5);
+    //first element is never a constraint, so linux.go isn't one
+    QStringList parts = name.split('_');
+    int n = parts.size();
+    if(n >= 3 && knownOS.contains(parts[n - 2]) && knownArch.contains(parts[n - 1]))
+        return hasTag(parts[n - 2]) && hasTag(parts[n - 1]);
+    if(n >= 2 && (knownOS.contains(parts[n - 1]) || knownArch.contains(parts[n - 1])))
+        return hasTag(parts[n - 1]);
+    return true;
+}
+
+bool BuildContext::matchesExpression(const QString& expression) const
+{
+    return ExpressionEvaluator(*this, expression).evaluate();
+}
+
+bool BuildContext::matchesPlusBuildLine(const QString& line) const
+{
+    QStringList options = line.split(' ', QString::SkipEmptyParts);
+    if(options.isEmpty())
+        return true;
+    for(const QString& option : options)
+    {
+        bool satisfied = true;
+        for(const QString& term : option.split(','))
+        {
+            bool negated = term.startsWith('!');
+            if(hasTag(negated ? term.mid(1) : term) == negated)
+            {
+                satisfied = false;
+                break;
+            }
+        }
+        if(satisfied)
+            return true;
+    }
+    return false;
+}
+
+Preamble Preamble::scan(const QByteArray& data)
+{
+    Preamble preamble;
+    PreambleScanner(data, preamble).scan();
+    return preamble;
+}
+
+Preamble Preamble::read(const QString& path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return Preamble();
+    QByteArray data;
+    qint64 step = firstReadStep;
+    while(true)
+    {
+        QByteArray chunk = file.read(step);
+        data.append(chunk);
+        Preamble preamble = scan(data);
+        if(preamble.complete || chunk.size() < step || data.size() >= readLimit)
+            return preamble;
+        step *= 2;
+    }
+}
+
+bool Preamble::matches(const BuildContext& context, const QString& fileName) const
+{
+    if(!context.matchesFileName(QFileInfo(fileName).fileName()))
+        return false;
+    //go:build line supersedes +build lines
+    if(!goBuild.isEmpty())
+        return context.matchesExpression(goBuild);
+    for(const QString& line : plusBuild)
+    {
+        if(!context.matchesPlusBuildLine(line))
+            return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,108 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGPREAMBLE_H
+#define GOLANGPREAMBLE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+#include "goparserexport.h"
+
+namespace go
+{
+
+/**
+ * Target platform and build tags files are selected for, like go/build.Context.
+ */
+class KDEVGOPARSER_EXPORT BuildContext
+{
+public:
+    QString goos;
+    QString goarch;
+    QStringList tags;
+    bool cgo = true;
+
+    /**
+     * Context packages are resolved for: $GOOS, $GOARCH, -tags from $GOFLAGS and $CGO_ENABLED,
+     * with host platform used for variables that aren't set. Can be overridden with setCurrent().
+     */
+    static BuildContext current();
+
+    /**
+     * Replaces current context. Cached package listings are dropped, as they depend on it.
+     */
+    static void setCurrent(const BuildContext& context);
+
+    /**
+     * Returns true if build tag @p tag is satisfied in this context.
+     */
+    bool hasTag(const QString& tag) const;
+
+    /**
+     * Checks _GOOS, _GOARCH and _GOOS_GOARCH suffixes of file name.
+     */
+    bool matchesFileName(const QString& fileName) const;
+
+    /**
+     * Evaluates //go:build expression.
+     * Malformed expressions are treated as satisfied, so such files are not lost.
+     */
+    bool matchesExpression(const QString& expression) const;
+
+    /**
+     * Evaluates old style // +build line: space separated options, each a comma separated list of terms.
+     */
+    bool matchesPlusBuildLine(const QString& line) const;
+};
+
+/**
+ * What can be learnt about a file from its beginning without parsing it: build constraints,
+ * package name with canonical import comment and imports. Scanning stops at the first declaration
+ * after imports.
+ */
+class KDEVGOPARSER_EXPORT Preamble
+{
+public:
+    QString packageName;
+    QString canonicalImport;
+    QStringList imports;
+    //expression of //go:build line
+    QString goBuild;
+    //contents of // +build lines
+    QStringList plusBuild;
+    //whether scanning got past the imports, false if data ended before that
+    bool complete = false;
+
+    static Preamble scan(const QByteArray& data);
+
+    /**
+     * Reads file at @p path only as far as needed to scan its preamble.
+     */
+    static Preamble read(const QString& path);
+
+    /**
+     * Returns true if file @p fileName with this preamble is part of build in @p context.
+     */
+    bool matches(const BuildContext& context, const QString& fileName) const;
+};
+
+}
+
+#endif
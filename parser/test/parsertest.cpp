@@ -24,6 +24,20 @@
 #include "parser/godebugvisitor.h"
 #include "parser/gotokentext.h"
 #include "parsesession.h"
+#include "poolrecycler.h"
+#include "tokenpositions.h"
+#include "fastlexer.h"
+#include "packagecache.h"
+#include "modulegraph.h"
+#include "preamble.h"
+#include "importgraph.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <limits>
 
 
 QTEST_MAIN(go::ParserTest)
@@ -237,6 +251,555 @@ void ParserTest::testForRangeLoop()
     QVERIFY(session.startParsing());
 }
 
+/**
+ * Generates a big, syntactically correct Go file,
+ * so that benchmarks measure lexer and parser rather than setup costs.
+ **/
+QByteArray generateSource(int functions)
+{
+    QByteArray code = "package main\n\nimport \"fmt\"\n\n";
+    code.append("var table = []byte{");
+    for(int i = 0; i < functions * 8; ++i)
+        code.append(QByteArray::number(i % 256)).append(i % 16 == 15 ? ",\n" : ", ");
+    code.append("}\n\n");
+    for(int i = 0; i < functions; ++i)
+    {
+        QByteArray number = QByteArray::number(i);
+        code.append("type point" + number + " struct {\n\tx, y float64\n\tname string\n}\n\n");
+        code.append("// length" + number + " computes something to parse\n");
+        code.append("func (p *point" + number + ") length" + number + "(scale int) (float64, error) {\n");
+        code.append("\tsum := 0.0\n\tfor i := 0; i < scale; i++ {\n");
+        code.append("\t\tif i%2 == 0 {\n\t\t\tsum += p.x * 1.5e3\n\t\t} else {\n\t\t\tsum -= p.y\n\t\t}\n\t}\n");
+        code.append("\tfmt.Println(p.name, `raw\nstring`, 'x')\n");
+        code.append("\treturn sum, nil\n}\n\n");
+    }
+    return code;
+}
+
+void ParserTest::testLexerErrors_data()
+{
+    QTest::addColumn<int>("mode");
+    QTest::newRow("streaming") << static_cast<int>(ParseSession::Streaming);
+    QTest::newRow("prelexed") << static_cast<int>(ParseSession::Prelexed);
+}
+
+void ParserTest::testLexerErrors()
+{
+    QFETCH(int, mode);
+    ParseSession valid("package main; func main() { a := 1 }", 0);
+    valid.setTokenizationMode(static_cast<ParseSession::TokenizationMode>(mode));
+    QVERIFY(valid.startParsing());
+    QVERIFY(!valid.hasLexerErrors());
+
+    //'@' is not a valid Go token, parser must not accept file even if it recovers
+    ParseSession invalid("package main; func main() { a := 1 @ }", 0);
+    invalid.setTokenizationMode(static_cast<ParseSession::TokenizationMode>(mode));
+    QVERIFY(!invalid.startParsing());
+    QVERIFY(invalid.hasLexerErrors());
+}
+
+void ParserTest::testPoolRecycling()
+{
+    QByteArray code = "package main; func main() { a := 1 }";
+    {
+        ParseSession session(code, 0);
+        //declarations-only parse leaves skipFunctionBodies set in parser
+        session.setFeatures(KDevelop::TopDUContext::AllDeclarationsAndContexts);
+        QVERIFY(session.startParsing());
+    }
+    qint64 warm = PoolRecycler::warmBytes();
+    QVERIFY(warm > 0);
+    {
+        ParseSession session(code, 0);
+        //pool is taken from cache instead of being allocated
+        QVERIFY(PoolRecycler::warmBytes() < warm);
+        QVERIFY(session.startParsing());
+        auto function = session.ast()->sourceFile->topDeclarationsSequence->front()->element->funcDecl;
+        QVERIFY(function);
+        //recycled parser must not skip bodies and recycled pool must be clean
+        QVERIFY(function->body);
+        QVERIFY(!function->body->ducontext);
+    }
+    QCOMPARE(PoolRecycler::warmBytes(), warm);
+}
+
+void ParserTest::testSkippedExternalFunctions()
+{
+    //declaration of external function has no body, so skipping bodies must not swallow what follows it
+    ParseSession session("package main; func external(a int); func main() { a := 1 }", 0);
+    session.setFeatures(KDevelop::TopDUContext::AllDeclarationsAndContexts);
+    QVERIFY(session.startParsing());
+    QStringList functions;
+    auto iter = session.ast()->sourceFile->topDeclarationsSequence->front(), end = iter;
+    do
+    {
+        if(iter->element->funcDecl)
+            functions.append(session.symbol(iter->element->funcDecl->funcName->id));
+        iter = iter->next;
+    }
+    while(iter != end);
+    QCOMPARE(functions, QStringList() << "external" << "main");
+}
+
+void ParserTest::testIdentifierInterning()
+{
+    ParseSession session("package main; func main() { main := main }", 0);
+    QVERIFY(session.startParsing());
+    //tokens: package main ; func main ( ) { main := main
+    QCOMPARE(session.identifier(1).toString(), QString("main"));
+    QCOMPARE(session.identifier(1), session.identifier(4));
+    QCOMPARE(session.identifier(8), session.identifier(10));
+    QCOMPARE(session.identifier(3).toString(), session.symbol(3));
+    QVERIFY(session.identifier(1000).isEmpty());
+}
+
+void ParserTest::testTokenPositions()
+{
+    QByteArray code = "package main\n\nfunc  main() {\n\t/* multi\nline */ a := `raw\nstring`\n}\n";
+    KDevPG::QByteArrayIterator iter(code);
+    Lexer lexer(iter);
+    TokenPositions positions(code, &lexer);
+    while(lexer.read().kind != TokenTypeWrapper::Token_EOF);
+
+    QCOMPARE(positions.lineCount(), 8);
+    //package
+    QCOMPARE(positions.start(0).line, 0);
+    QCOMPARE(positions.start(0).column, 0);
+    QCOMPARE(positions.end(0).column, 7);
+    //main on first line, then semicolon inserted at newline
+    QCOMPARE(positions.start(1).column, 8);
+    QCOMPARE(lexer.at(2).kind, static_cast<int>(TokenTypeWrapper::Token_SEMICOLON));
+    //func
+    QCOMPARE(positions.start(3).line, 2);
+    QCOMPARE(positions.start(3).column, 0);
+    //main after two spaces
+    QCOMPARE(positions.start(4).line, 2);
+    QCOMPARE(positions.start(4).column, 6);
+    QCOMPARE(positions.end(4).column, 10);
+    //a after multiline comment
+    QCOMPARE(lexer.at(8).kind, static_cast<int>(TokenTypeWrapper::Token_IDENT));
+    QCOMPARE(positions.start(8).line, 4);
+    QCOMPARE(positions.start(8).column, 8);
+    //arbitrary offsets
+    QCOMPARE(positions.positionAt(code.indexOf("line")).line, 4);
+    QCOMPARE(positions.positionAt(code.indexOf("line")).column, 0);
+    QCOMPARE(positions.positionAt(code.indexOf("string")).line, 5);
+}
+
+/**
+ * Lexes @p code with both generated and hand-written lexers
+ * and returns description of the first difference or an empty string.
+ **/
+QString compareLexers(const QByteArray& code)
+{
+    KDevPG::QByteArrayIterator iter(code);
+    Lexer generated(iter);
+    while(generated.read().kind != TokenTypeWrapper::Token_EOF);
+
+    QByteArray noInput;
+    KDevPG::QByteArrayIterator emptyIter(noInput);
+    Lexer handWritten(emptyIter);
+    FastLexer(code).tokenize(&handWritten);
+
+    for(qint64 i = 0; i < generated.size() && i < handWritten.size(); ++i)
+    {
+        const KDevPG::Token& expected = generated.at(i);
+        const KDevPG::Token& actual = handWritten.at(i);
+        if(expected.kind != actual.kind || (expected.kind != TokenTypeWrapper::Token_EOF &&
+            (expected.begin != actual.begin || expected.end != actual.end)))
+            return QString("token %1: generated %2 [%3, %4], hand-written %5 [%6, %7]").arg(i)
+                .arg(tokenText(expected.kind)).arg(expected.begin).arg(expected.end)
+                .arg(tokenText(actual.kind)).arg(actual.begin).arg(actual.end);
+    }
+    if(generated.size() != handWritten.size())
+        return QString("token count: generated %1, hand-written %2").arg(generated.size()).arg(handWritten.size());
+    return QString();
+}
+
+void ParserTest::testHandWrittenLexer_data()
+{
+    QTest::addColumn<QByteArray>("code");
+
+    for(const QString& name : {"main.go", "utf8.go", "test.file"})
+    {
+        QFile file(QFINDTESTDATA(name));
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QTest::newRow(qPrintable(name)) << file.readAll();
+    }
+    QTest::newRow("numbers") << QByteArray("0 07 089 0x1F 0X 0xg 1e5 1E+5 1e- 1.5 1. .5 .5e-3 1.e3 1i 1.5i .5i 0789.5 1.5ei 3..5\n");
+    QTest::newRow("runes") << QByteArray("'a' '\\n' '\\'' '\\\\' '\\\"' '\\x41' '\\u12e4' '\\U00101234' '\\101' '\\'x ''' 'ab' '\xd1\x89'\n");
+    QTest::newRow("strings") << QByteArray("\"a\\\"b\" \"multi\nline\" `raw\n\\string` \"\" x\n");
+    QTest::newRow("semicolons") << QByteArray("a\n1\n'a'\n\"s\"\n`r`\nbreak\ncontinue\nfallthrough\nreturn\ni++\ni--\n)\n]\n}\n{\n+\n{ a }\n{ }\n");
+    QTest::newRow("comments") << QByteArray("a // comment\nb /* multi\nline */ c /*/ still comment */ d /* unterminated\n");
+    QTest::newRow("operators") << QByteArray("&^= &^ &= && <<= << <= <- >>= >> >= ... .. . := : != ! == = += ++ -= -- |= || *= ^= %= /= /\n");
+    QTest::newRow("unknown symbols") << QByteArray("a @ b # c \r\n \"unterminated\n ~ $ \xe2\x86\x92 ? \x80\n");
+    QTest::newRow("unicode identifiers") << QByteArray("\xd1\x84\xd1\x83 _x\xc5\x9d" "9 \xe6\x97\xa5\xe6\x9c\xac\n");
+    QTest::newRow("unterminated raw string") << QByteArray("a := `never\nclosed");
+    QTest::newRow("no trailing newline") << QByteArray("return x");
+    QTest::newRow("generated") << generateSource(50);
+}
+
+void ParserTest::testHandWrittenLexer()
+{
+    QFETCH(QByteArray, code);
+    QCOMPARE(compareLexers(code), QString());
+}
+
+void ParserTest::testHandWrittenLexerOnGoroot()
+{
+    QString goroot = QString::fromLocal8Bit(qgetenv("GOROOT"));
+    if(goroot.isEmpty() || !QDir(goroot + "/src").exists())
+        QSKIP("GOROOT is not set, skipping comparison on Go sources");
+    //keep test time reasonable, whole GOROOT takes a while with generated lexer
+    const int maxFiles = 3000;
+    int files = 0;
+    QDirIterator iter(goroot + "/src", QStringList() << "*.go", QDir::Files, QDirIterator::Subdirectories);
+    while(iter.hasNext() && files < maxFiles)
+    {
+        QFile file(iter.next());
+        if(!file.open(QIODevice::ReadOnly))
+            continue;
+        QString difference = compareLexers(file.readAll());
+        if(!difference.isEmpty())
+            QFAIL(qPrintable(file.fileName() + ": " + difference));
+        files++;
+    }
+}
+
+void ParserTest::testChunkedLexing()
+{
+    //long comments and literals make some chunk boundaries fall inside them
+    QByteArray code = generateSource(200);
+    code.append("/* long\n");
+    for(int i = 0; i < 2000; ++i)
+        code.append("comment line\n");
+    code.append("*/\nvar raw = `\n");
+    for(int i = 0; i < 2000; ++i)
+        code.append("raw string line\n");
+    code.append("`\nvar s = \"multi\n");
+    for(int i = 0; i < 2000; ++i)
+        code.append("line string\n");
+    code.append("\"\n");
+    code.append(generateSource(200));
+
+    QByteArray noInput;
+    KDevPG::QByteArrayIterator sequentialIter(noInput);
+    Lexer sequential(sequentialIter);
+    FastLexer sequentialLexer(code);
+    sequentialLexer.setParallelThreshold(std::numeric_limits<qint64>::max());
+    QVERIFY(sequentialLexer.tokenize(&sequential));
+
+    for(qint64 threshold : {qint64(0), qint64(4096), qint64(code.size() / 3)})
+    {
+        KDevPG::QByteArrayIterator chunkedIter(noInput);
+        Lexer chunked(chunkedIter);
+        FastLexer chunkedLexer(code);
+        chunkedLexer.setParallelThreshold(threshold);
+        QVERIFY(chunkedLexer.tokenize(&chunked));
+        QCOMPARE(chunked.size(), sequential.size());
+        for(qint64 i = 0; i < sequential.size(); ++i)
+        {
+            QCOMPARE(chunked.at(i).kind, sequential.at(i).kind);
+            QCOMPARE(chunked.at(i).begin, sequential.at(i).begin);
+            QCOMPARE(chunked.at(i).end, sequential.at(i).end);
+        }
+        qint64 line, column, expectedLine, expectedColumn;
+        chunked.locationTable()->positionAt(code.size() - 1, &line, &column);
+        sequential.locationTable()->positionAt(code.size() - 1, &expectedLine, &expectedColumn);
+        QCOMPARE(line, expectedLine);
+        QCOMPARE(column, expectedColumn);
+    }
+}
+
+void ParserTest::testPackageCache()
+{
+    QTemporaryDir searchPath;
+    QVERIFY(searchPath.isValid());
+    QDir root(searchPath.path());
+    QVERIFY(root.mkpath("first/pack"));
+    QVERIFY(root.mkpath("second/pack"));
+    QVERIFY(root.mkpath("second/other"));
+    for(const QString& name : {"first/pack/a.go", "first/pack/b.go", "first/pack/notes.txt", "second/other/c.go"})
+    {
+        QFile file(root.filePath(name));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+    }
+    QList<QString> searchPaths{root.filePath("first"), root.filePath("second")};
+
+    PackageCache::clear();
+    PackageCache::setRevalidationInterval(60 * 60 * 1000);
+    QCOMPARE(PackageCache::findPackage("pack", searchPaths), root.filePath("first/pack"));
+    QCOMPARE(PackageCache::findPackage("other", searchPaths), root.filePath("second/other"));
+    QVERIFY(PackageCache::findPackage("missing", searchPaths).isEmpty());
+    PackageCache::Package package = PackageCache::package(root.filePath("first/pack"));
+    QVERIFY(package.exists);
+    QCOMPARE(package.files, QStringList() << root.filePath("first/pack/a.go") << root.filePath("first/pack/b.go"));
+
+    //within revalidation interval cached listings are trusted, missing directories included
+    QVERIFY(root.mkpath("first/missing"));
+    QFile(root.filePath("first/pack/d.go")).open(QIODevice::WriteOnly);
+    QVERIFY(PackageCache::findPackage("missing", searchPaths).isEmpty());
+    QCOMPARE(PackageCache::package(root.filePath("first/pack")).files.size(), 2);
+
+    PackageCache::clear();
+    QCOMPARE(PackageCache::findPackage("missing", searchPaths), root.filePath("first/missing"));
+    QCOMPARE(PackageCache::package(root.filePath("first/pack")).files.size(), 3);
+    PackageCache::setRevalidationInterval(PackageCache::DefaultRevalidationInterval);
+}
+
+void ParserTest::testModuleGraph()
+{
+    QTemporaryDir workspace;
+    QVERIFY(workspace.isValid());
+    QDir root(workspace.path());
+    auto writeFile = [&root](const QString& name, const QByteArray& contents) {
+        QVERIFY(root.mkpath(QFileInfo(root.filePath(name)).path()));
+        QFile file(root.filePath(name));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+    };
+    writeFile("work/go.work", "go 1.18\n\nuse (\n\t./app\n\t./lib // comment\n)\nreplace example.org/fork => example.org/upstream v0.1.0\n");
+    writeFile("work/app/go.mod", "module example.org/app\n\nrequire (\n\tgithub.com/Foo/bar v1.2.3\n\texample.org/fork v0.0.1 // indirect\n)\n"
+                                 "require example.org/local v0.0.0\nreplace example.org/local => ../local\n");
+    writeFile("work/lib/go.mod", "module example.org/lib\nrequire github.com/Foo/bar v1.10.0\n");
+    writeFile("single/go.mod", "module example.org/single\nrequire github.com/Foo/bar v1.2.3\n");
+    writeFile("single/vendor/modules.txt", "# github.com/Foo/bar v1.2.3\n");
+    qputenv("GOMODCACHE", root.filePath("modcache").toLocal8Bit());
+    ModuleGraph::clearCache();
+
+    QVERIFY(!ModuleGraph::forDirectory(workspace.path()));
+    std::shared_ptr<const ModuleGraph> graph = ModuleGraph::forDirectory(root.filePath("work/app/sub"));
+    QVERIFY(graph);
+    QCOMPARE(graph->root(), root.filePath("work"));
+    QCOMPARE(ModuleGraph::forDirectory(root.filePath("work/app/sub")).get(), graph.get());
+    QCOMPARE(graph->packageDirectory("example.org/app/sub"), root.filePath("work/app/sub"));
+    QCOMPARE(graph->packageDirectory("example.org/lib"), root.filePath("work/lib"));
+    //the highest required version wins
+    QCOMPARE(graph->packageDirectory("github.com/Foo/bar/baz"), root.filePath("modcache/github.com/!foo/bar@v1.10.0/baz"));
+    QCOMPARE(graph->packageDirectory("example.org/local/pkg"), root.filePath("work/local/pkg"));
+    QCOMPARE(graph->packageDirectory("example.org/fork"), root.filePath("modcache/example.org/upstream@v0.1.0"));
+    QVERIFY(graph->packageDirectory("fmt").isEmpty());
+
+    std::shared_ptr<const ModuleGraph> single = ModuleGraph::forDirectory(root.filePath("single"));
+    QVERIFY(single);
+    QCOMPARE(single->packageDirectory("github.com/Foo/bar/baz"), root.filePath("single/vendor/github.com/Foo/bar/baz"));
+    QCOMPARE(single->packageDirectory("example.org/single/x"), root.filePath("single/x"));
+
+    //changing go.mod reloads the graph, once cached graph is due for revalidation
+    PackageCache::setRevalidationInterval(0);
+    writeFile("work/lib/go.mod", "module example.org/lib\nrequire github.com/Foo/bar v1.2.4\n");
+    graph = ModuleGraph::forDirectory(root.filePath("work/app/sub"));
+    QCOMPARE(graph->packageDirectory("github.com/Foo/bar"), root.filePath("modcache/github.com/!foo/bar@v1.2.4"));
+    //deleting go.work leaves the nearest go.mod in charge
+    QVERIFY(QFile::remove(root.filePath("work/go.work")));
+    graph = ModuleGraph::forDirectory(root.filePath("work/app/sub"));
+    QVERIFY(graph);
+    QCOMPARE(graph->root(), root.filePath("work/app"));
+    //creating go.mod puts directory in module mode
+    writeFile("go.mod", "module example.org/root\n");
+    graph = ModuleGraph::forDirectory(workspace.path());
+    QVERIFY(graph);
+    QCOMPARE(graph->packageDirectory("example.org/root/x"), root.filePath("x"));
+    PackageCache::setRevalidationInterval(PackageCache::DefaultRevalidationInterval);
+    qunsetenv("GOMODCACHE");
+}
+
+void ParserTest::testPreamble()
+{
+    Preamble preamble = Preamble::scan("// Copyright\n\n//go:build linux && !cgo\n// +build linux,!cgo\n\n// Package docs\n"
+                                       "package foo // import \"example.org/foo\"\n\nimport \"fmt\"\nimport (\n\tstr \"strings\"\n"
+                                       "\t. `os` // comment\n\t_ \"unsafe\"; /* block */ \"io\"\n)\n\nfunc main() {}\n");
+    QVERIFY(preamble.complete);
+    QCOMPARE(preamble.packageName, QString("foo"));
+    QCOMPARE(preamble.canonicalImport, QString("example.org/foo"));
+    QCOMPARE(preamble.imports, QStringList({"fmt", "strings", "os", "unsafe", "io"}));
+    QCOMPARE(preamble.goBuild, QString("linux && !cgo"));
+    QCOMPARE(preamble.plusBuild, QStringList("linux,!cgo"));
+    //constraints in package documentation don't count
+    preamble = Preamble::scan("// +build ignore\npackage foo\nimport \"fmt\"\n");
+    QVERIFY(preamble.plusBuild.isEmpty());
+    QVERIFY(!preamble.complete);
+    QCOMPARE(preamble.imports, QStringList("fmt"));
+
+    BuildContext context;
+    context.goos = "linux";
+    context.goarch = "amd64";
+    context.tags = QStringList("integration");
+    context.cgo = false;
+    QVERIFY(context.hasTag("unix"));
+    QVERIFY(context.hasTag("go1.18"));
+    QVERIFY(!context.hasTag("cgo"));
+    QVERIFY(context.matchesFileName("file_linux.go"));
+    QVERIFY(context.matchesFileName("file_linux_amd64_test.go"));
+    QVERIFY(context.matchesFileName("linux.go"));
+    QVERIFY(context.matchesFileName("file_unix.go"));
+    QVERIFY(!context.matchesFileName("file_windows.go"));
+    QVERIFY(!context.matchesFileName("file_linux_arm64.go"));
+    QVERIFY(context.matchesExpression("(linux || darwin) && integration && !cgo"));
+    QVERIFY(!context.matchesExpression("windows || (linux && !amd64)"));
+    QVERIFY(context.matchesExpression("linux &&"));
+    QVERIFY(context.matchesPlusBuildLine("windows linux,!cgo"));
+    QVERIFY(!context.matchesPlusBuildLine("windows !amd64"));
+    QVERIFY(preamble.matches(context, "foo.go"));
+    QVERIFY(!Preamble::scan("//go:build ignore\n\npackage main\n").matches(context, "gen.go"));
+
+    //files excluded for current context are left out of build files
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QDir dir(directory.path());
+    auto writeFile = [&dir](const QString& name, const QByteArray& contents) {
+        QFile file(dir.filePath(name));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+    };
+    writeFile("bar.go", "package bar\n");
+    writeFile("bar_other.go", "//go:build " + QByteArray(BuildContext::current().goos == "plan9" ? "!plan9" : "plan9") + "\n\npackage bar\n");
+    writeFile("gen.go", "//go:build ignore\n\npackage main\n");
+    writeFile("bar_test.go", "package bar_test\n");
+    PackageCache::clear();
+    PackageCache::Package package = PackageCache::package(directory.path());
+    QCOMPARE(package.name, QString("bar"));
+    QCOMPARE(package.buildFiles, QStringList(dir.filePath("bar.go")));
+    QCOMPARE(package.packageNames[dir.filePath("bar_test.go")], QString("bar_test"));
+
+    //editing files in place doesn't touch directory, but is seen once listing is revalidated
+    PackageCache::setRevalidationInterval(0);
+    writeFile("bar.go", "package baz\n\nimport \"fmt\"\n");
+    writeFile("bar_other.go", "package baz\n");
+    package = PackageCache::package(directory.path());
+    QCOMPARE(package.name, QString("baz"));
+    QCOMPARE(package.buildFiles, QStringList({dir.filePath("bar.go"), dir.filePath("bar_other.go")}));
+    QCOMPARE(package.packageNames[dir.filePath("bar.go")], QString("baz"));
+    QCOMPARE(package.imports, QStringList("fmt"));
+    PackageCache::setRevalidationInterval(PackageCache::DefaultRevalidationInterval);
+}
+
+void ParserTest::testImportGraph()
+{
+    QTemporaryDir workspace;
+    QVERIFY(workspace.isValid());
+    QDir root(workspace.path());
+    auto writeFile = [&root](const QString& name, const QByteArray& contents) {
+        QVERIFY(root.mkpath(QFileInfo(root.filePath(name)).path()));
+        QFile file(root.filePath(name));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+    };
+    writeFile("app/main.go", "package main\nimport (\n\t\"a\"\n\t\"c\"\n\t\"missing\"\n)\n");
+    writeFile("a/a.go", "package a\nimport \"b\"\n");
+    writeFile("a/a_test.go", "package a\nimport \"d\"\n");
+    writeFile("b/b.go", "package b\nimport (\"c\"; \"C\")\n");
+    writeFile("c/c.go", "package c\n");
+    writeFile("d/d.go", "package d\n");
+    writeFile("e/e.go", "package e\n");
+    PackageCache::clear();
+
+    QStringList resolved;
+    ImportGraph graph = ImportGraph::build(root.filePath("app"), QStringList("e"), [&root, &resolved](const QString& importPath) {
+        resolved.append(importPath);
+        return QFileInfo(root.filePath(importPath)).isDir() ? root.filePath(importPath) : QString();
+    });
+    //imports of test files are not followed and every import is resolved once
+    QCOMPARE(graph.packages().size(), 5);
+    QCOMPARE(resolved.count("c"), 1);
+    QCOMPARE(graph.packages()[root.filePath("a")].files, QStringList(root.filePath("a/a.go")));
+    QCOMPARE(graph.packages()[root.filePath("b")].dependencies, QStringList(root.filePath("c")));
+    QList<QStringList> levels = graph.levels();
+    QCOMPARE(levels.size(), 4);
+    QCOMPARE(levels[0], QStringList({root.filePath("c"), root.filePath("e")}));
+    QCOMPARE(levels[1], QStringList(root.filePath("b")));
+    QCOMPARE(levels[2], QStringList(root.filePath("a")));
+    QCOMPARE(levels[3], QStringList(graph.root()));
+}
+
+void ParserTest::testPackageDeduplication()
+{
+    QTemporaryDir workspace;
+    QVERIFY(workspace.isValid());
+    QDir root(workspace.path());
+    auto writeFile = [&root](const QString& name, const QByteArray& contents) {
+        QVERIFY(root.mkpath(QFileInfo(root.filePath(name)).path()));
+        QFile file(root.filePath(name));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+    };
+    writeFile("one/vendor/lib/lib.go", "package lib\nfunc F() {}\n");
+    writeFile("two/vendor/lib/lib.go", "package lib\nfunc F() {}\n");
+    writeFile("three/vendor/lib/lib.go", "package lib\nfunc F() int { return 1 }\n");
+    writeFile("four/vendor/lib/other.go", "package lib\nfunc F() {}\n");
+    PackageCache::clear();
+    PackageCache::setRevalidationInterval(0);
+
+    //copies resolve their imports to the same directories, unless told otherwise
+    QHash<QString, QStringList> imports;
+    int resolved = 0;
+    auto resolve = [&imports, &resolved](const QString& directory) {
+        resolved++;
+        return imports.value(directory);
+    };
+    QString one = root.filePath("one/vendor/lib");
+    QVERIFY(!PackageCache::contentHash(one).isEmpty());
+    QCOMPARE(PackageCache::contentHash(root.filePath("two/vendor/lib")), PackageCache::contentHash(one));
+    //the only directory of an import is not hashed at all
+    QCOMPARE(PackageCache::canonicalDirectory("lib", one, resolve), one);
+    QCOMPARE(resolved, 0);
+    QCOMPARE(PackageCache::canonicalDirectory("lib", root.filePath("two/vendor/lib"), resolve), one);
+    QVERIFY(resolved > 0);
+    //different contents or file names are different packages
+    QCOMPARE(PackageCache::canonicalDirectory("lib", root.filePath("three/vendor/lib"), resolve), root.filePath("three/vendor/lib"));
+    QCOMPARE(PackageCache::canonicalDirectory("lib", root.filePath("four/vendor/lib"), resolve), root.filePath("four/vendor/lib"));
+    QVERIFY(PackageCache::contentHash(root.filePath("missing")).isEmpty());
+    //copies of different imports are never compared
+    QCOMPARE(PackageCache::canonicalDirectory("example.org/lib", root.filePath("two/vendor/lib"), resolve), root.filePath("two/vendor/lib"));
+    //identical copies importing different packages are different packages
+    imports.insert(root.filePath("two/vendor/lib"), QStringList(root.filePath("two/vendor/dep")));
+    QCOMPARE(PackageCache::canonicalDirectory("lib", root.filePath("two/vendor/lib"), resolve), root.filePath("two/vendor/lib"));
+    imports.clear();
+
+    //once the first copy changes, the next one takes over
+    writeFile("one/vendor/lib/lib.go", "package lib\nfunc F() {}\nfunc G() {}\n");
+    QCOMPARE(PackageCache::canonicalDirectory("lib", root.filePath("two/vendor/lib"), resolve), root.filePath("two/vendor/lib"));
+    QCOMPARE(PackageCache::canonicalDirectory("lib", one, resolve), one);
+    //changed file is read again, restoring it restores hash
+    writeFile("one/vendor/lib/lib.go", "package lib\nfunc F() {}\n");
+    QCOMPARE(PackageCache::contentHash(one), PackageCache::contentHash(root.filePath("two/vendor/lib")));
+    PackageCache::setRevalidationInterval(PackageCache::DefaultRevalidationInterval);
+}
+
+void ParserTest::benchmarkLexers_data()
+{
+    QTest::addColumn<int>("backend");
+    QTest::newRow("generated") << static_cast<int>(ParseSession::GeneratedLexer);
+    QTest::newRow("hand-written") << static_cast<int>(ParseSession::HandWrittenLexer);
+}
+
+void ParserTest::benchmarkLexers()
+{
+    QFETCH(int, backend);
+    QByteArray code = generateSource(2000);
+    QBENCHMARK {
+        ParseSession session(code, 0);
+        session.setLexerBackend(static_cast<ParseSession::LexerBackend>(backend));
+        QVERIFY(session.startParsing());
+    }
+}
+
+void ParserTest::benchmarkParsing_data()
+{
+    testLexerErrors_data();
+}
+
+void ParserTest::benchmarkParsing()
+{
+    QFETCH(int, mode);
+    QByteArray code = generateSource(2000);
+    QBENCHMARK {
+        ParseSession session(code, 0);
+        session.setTokenizationMode(static_cast<ParseSession::TokenizationMode>(mode));
+        QVERIFY(session.startParsing());
+    }
+}
+
 
 
 //add this tests:
@@ -38,6 +38,25 @@ private slots:
   void testIfClause();
   void testFuncTypes();
   void testForRangeLoop();
+  void testLexerErrors_data();
+  void testLexerErrors();
+  void testPoolRecycling();
+  void testSkippedExternalFunctions();
+  void testIdentifierInterning();
+  void testTokenPositions();
+  void testHandWrittenLexer_data();
+  void testHandWrittenLexer();
+  void testHandWrittenLexerOnGoroot();
+  void testChunkedLexing();
+  void testPackageCache();
+  void testModuleGraph();
+  void testPreamble();
+  void testImportGraph();
+  void testPackageDeduplication();
+  void benchmarkParsing_data();
+  void benchmarkParsing();
+  void benchmarkLexers_data();
+  void benchmarkLexers();
   
 };
 
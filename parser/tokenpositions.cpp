@@ -0,0 +1,120 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#include "tokenpositions.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace go
+{
+
+TokenPositions::TokenPositions(const QByteArray& contents, KDevPG::TokenStream* tokens) : m_contents(contents),
+                                                                                              m_tokens(tokens),
+                                                                                              m_linesScanned(false),
+                                                                                              m_currentLine(0)
+{
+}
+
+void TokenPositions::scanLines()
+{
+    m_linesScanned = true;
+    m_lineStarts.append(0);
+    const char* begin = m_contents.constData();
+    const char* end = begin + m_contents.size();
+    const char* pos = begin;
+    while(pos < end)
+    {
+        const char* newline = static_cast<const char*>(memchr(pos, '\n', end - pos));
+        if(!newline)
+            break;
+        pos = newline + 1;
+        m_lineStarts.append(pos - begin);
+    }
+}
+
+TokenPositions::Position TokenPositions::positionFrom(qint64 offset, int& line) const
+{
+    //common case: offset is on current or one of the next few lines
+    int lines = m_lineStarts.size();
+    if(offset >= m_lineStarts[line])
+    {
+        int limit = std::min(line + 8, lines);
+        while(line + 1 < limit && m_lineStarts[line + 1] <= offset)
+            ++line;
+        if(line + 1 < lines && m_lineStarts[line + 1] <= offset)
+            line = std::upper_bound(m_lineStarts.constBegin() + line, m_lineStarts.constEnd(), offset) - m_lineStarts.constBegin() - 1;
+    }
+    else
+        line = std::upper_bound(m_lineStarts.constBegin(), m_lineStarts.constBegin() + line, offset) - m_lineStarts.constBegin() - 1;
+    if(line < 0)
+        line = 0;
+    return Position{line, static_cast<qint32>(offset - m_lineStarts[line])};
+}
+
+void TokenPositions::ensure(qint64 token)
+{
+    if(!m_linesScanned)
+        scanLines();
+    qint64 count = m_starts.size();
+    if(token < count)
+        return;
+    qint64 size = std::min(m_tokens->size(), token + 1);
+    m_starts.resize(size);
+    m_ends.resize(size);
+    for(qint64 i = count; i < size; ++i)
+    {
+        const KDevPG::Token& t = m_tokens->at(i);
+        m_starts[i] = positionFrom(t.begin, m_currentLine);
+        int endLine = m_currentLine;
+        m_ends[i] = positionFrom(t.end + 1, endLine);
+    }
+}
+
+TokenPositions::Position TokenPositions::start(qint64 token)
+{
+    ensure(token);
+    if(token < 0 || token >= m_starts.size())
+        return Position{-1, -1};
+    return m_starts[token];
+}
+
+TokenPositions::Position TokenPositions::end(qint64 token)
+{
+    ensure(token);
+    if(token < 0 || token >= m_ends.size())
+        return Position{-1, -1};
+    return m_ends[token];
+}
+
+TokenPositions::Position TokenPositions::positionAt(qint64 offset)
+{
+    if(!m_linesScanned)
+        scanLines();
+    int line = 0;
+    return positionFrom(offset, line);
+}
+
+int TokenPositions::lineCount()
+{
+    if(!m_linesScanned)
+        scanLines();
+    return m_lineStarts.size();
+}
+
+}
@@ -0,0 +1,88 @@
+/*************************************************************************************
+*  Copyright (C) 2014 by Pavel Petrushkov <onehundredof@gmail.com>                  *
+*                                                                                   *
+*  This program is free software; you can redistribute it and/or                    *
+*  modify it under the terms of the GNU General Public License                      *
+*  as published by the Free Software Foundation; either version 2                   *
+*  of the License, or (at your option) any later version.                           *
+*                                                                                   *
+*  This program is distributed in the hope that it will be useful,                  *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of                   *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    *
+*  GNU General Public License for more details.                                     *
+*                                                                                   *
+*  You should have received a copy of the GNU General Public License                *
+*  along with this program; if not, write to the Free Software                      *
+*  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA   *
+*************************************************************************************/
+
+#ifndef GOLANGTOKENPOSITIONS_H
+#define GOLANGTOKENPOSITIONS_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include "goparserexport.h"
+#include "kdev-pg-token-stream.h"
+
+namespace go
+{
+
+/**
+ * Line and column of every token of a token stream.
+ * Line starts are found once with memchr, which is vectorized by every libc we care about,
+ * then positions are filled in token order by walking lines forward, so asking for a position
+ * of a token is an array load instead of a binary search in KDevPG::LocationTable.
+ * Columns are byte offsets from the start of line, starting from zero on every line.
+ */
+class KDEVGOPARSER_EXPORT TokenPositions
+{
+public:
+    struct Position
+    {
+        qint32 line;
+        qint32 column;
+    };
+
+    /**
+     * @p contents must be the same data @p tokens were lexed from.
+     * Tokens may still be appended to stream after construction(e.g. when parser pulls them from lexer),
+     * positions are computed for them on demand.
+     */
+    TokenPositions(const QByteArray& contents, KDevPG::TokenStream* tokens);
+
+    /**
+     * Position of the first character of @p token.
+     */
+    Position start(qint64 token);
+
+    /**
+     * Position right after the last character of @p token.
+     */
+    Position end(qint64 token);
+
+    /**
+     * Position of an arbitrary offset in contents.
+     */
+    Position positionAt(qint64 offset);
+
+    int lineCount();
+
+private:
+    void scanLines();
+    void ensure(qint64 token);
+    Position positionFrom(qint64 offset, int& line) const;
+
+    QByteArray m_contents;
+    KDevPG::TokenStream* m_tokens;
+    QVector<qint64> m_lineStarts;
+    QVector<Position> m_starts;
+    QVector<Position> m_ends;
+    bool m_linesScanned;
+    //line of the last computed token, tokens come in increasing offset order so next one starts searching here
+    int m_currentLine;
+};
+
+}
+
+#endif